@@ -0,0 +1,68 @@
+#pragma once
+
+#include "commonheader.h"
+
+#include "ray.h"
+
+#include <limits>
+
+/// Axis-aligned bounding box
+class Aabb
+{
+public:
+    /// creates an empty box (the neutral element of Union)
+    Aabb()
+    : m_min(std::numeric_limits<float>::max())
+    , m_max(-std::numeric_limits<float>::max())
+    { }
+
+    Aabb(const glm::vec3& minimum, const glm::vec3& maximum)
+    : m_min(minimum)
+    , m_max(maximum)
+    { }
+
+    const glm::vec3& Min() const { return m_min; }
+    const glm::vec3& Max() const { return m_max; }
+
+    bool IsEmpty() const { return m_min.x > m_max.x; }
+
+    glm::vec3 Center() const { return 0.5f * (m_min + m_max); }
+    glm::vec3 Extent() const { return m_max - m_min; }
+
+    /// index of the axis with the largest extent
+    int MaxExtentAxis() const
+    {
+        glm::vec3 e = Extent();
+        return (e.x > e.y && e.x > e.z) ? 0 : ((e.y > e.z) ? 1 : 2);
+    }
+
+    void Union(const glm::vec3& p)
+    {
+        m_min = glm::min(m_min, p);
+        m_max = glm::max(m_max, p);
+    }
+
+    void Union(const Aabb& other)
+    {
+        m_min = glm::min(m_min, other.m_min);
+        m_max = glm::max(m_max, other.m_max);
+    }
+
+    /// slab test with the precomputed reciprocal ray direction
+    bool Hit(const Ray& r, const glm::vec3& invDirection, float tMin, float tMax) const
+    {
+        glm::vec3 t0 = (m_min - r.Origin()) * invDirection;
+        glm::vec3 t1 = (m_max - r.Origin()) * invDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        tMin = glm::max(tMin, glm::max(tNear.x, glm::max(tNear.y, tNear.z)));
+        tMax = glm::min(tMax, glm::min(tFar.x, glm::min(tFar.y, tFar.z)));
+
+        return tMin <= tMax;
+    }
+
+private:
+    glm::vec3 m_min;
+    glm::vec3 m_max;
+};
@@ -0,0 +1,308 @@
+#pragma once
+
+#include "commonheader.h"
+
+#include "alignedallocator.h"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/// Byte order of the resolved 32-bit pixels (alpha is always the last byte)
+enum class PixelFormat
+{
+    RGBA,   ///< SDL_PIXELFORMAT_RGBA32
+    BGRA    ///< SDL_PIXELFORMAT_BGRA32, the native format of most windows and textures
+};
+
+/// Storage of the accumulated colors per pixel
+enum class AccumulationFormat
+{
+    Float,      ///< sums as three floats per pixel (12 bytes)
+    Half,       ///< running means as three half floats per pixel (6 bytes), for memory- and bandwidth-bound resolution
+    Double,     ///< sums as three doubles per pixel (24 bytes), for very high sample counts
+    Kahan,      ///< sums as three floats with Kahan compensation (24 bytes), for very high sample counts
+    Planar,     ///< sums as floats in a plane per channel (12 bytes), so the resolve loads 8 pixels of a channel at once
+    Count
+};
+
+const char* GetAccumulationFormatName(AccumulationFormat format);
+
+/// Accumulated colors of the pixels of the framebuffer (indexed like the rest of the framebuffer, i.e. with padded rows).
+/// Pixels are only accessed by the thread that renders their tile, so different pixels may be used concurrently.
+class AccumulationBuffer
+{
+public:
+    virtual ~AccumulationBuffer() = default;
+
+    virtual AccumulationFormat GetFormat() const = 0;
+    virtual size_t GetBytesPerPixel() const = 0;
+
+    /// Pixels that fill whole cache lines, so runs of pixels starting at multiples of it do not share lines
+    virtual int GetPixelAlignment() const = 0;
+
+    /// New pixels are not initialized (the threads that clear them touch their pages first)
+    virtual void Resize(size_t numPixels) = 0;
+
+    /// Resets count pixels starting at index
+    virtual void Clear(size_t index, size_t count) = 0;
+
+    /// Sum of the colors of the given number of passes
+    virtual glm::vec3 Get(size_t index, uint32_t passes) const = 0;
+
+    /// Adds the color of a pass to the passes accumulated so far
+    virtual void Add(size_t index, uint32_t passes, const glm::vec3& color) = 0;
+
+    /// Converts count pixels starting at index to 8 bits per channel: mean over the passes, clamped to 1, gamma 2
+    virtual void Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const = 0;
+
+    /// Continues an FNV-1a hash over the stored bytes
+    virtual uint64_t Hash(uint64_t hash) const = 0;
+};
+
+// Formats of the accumulation buffer: storage of the pixels and the per-pixel operations that TypedAccumulationBuffer
+// is instantiated with. The colors of a pixel are only read as their sum or mean. The per-pixel operations are defined
+// here, so code that works on a storage directly (see GetStorage()) can inline them.
+
+template <typename T>
+using AccumulationVector = std::vector<T, AlignedAllocator<T, CACHE_LINE_SIZE>>;
+
+/// Smallest number of pixels of the given size that fills whole cache lines (the line size is a power of two, so only
+/// the lowest set bit of the size matters: 16 pixels of 12 bytes, 32 of 6 bytes)
+constexpr int GetCacheLinePixels(size_t bytesPerPixel)
+{
+    return (bytesPerPixel & (~bytesPerPixel + 1)) >= CACHE_LINE_SIZE ? 1
+        : static_cast<int>(CACHE_LINE_SIZE / (bytesPerPixel & (~bytesPerPixel + 1)));
+}
+
+/// Rounds to the nearest half float (ties to even), values beyond the largest half are clamped to it
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    bits &= 0x7FFFFFFFu;
+
+    if (bits > 0x7F800000u)
+    {
+        return static_cast<uint16_t>(sign | 0x7E00u);   // NaN
+    }
+    if (bits >= 0x477FF000u)
+    {
+        return static_cast<uint16_t>(sign | 0x7BFFu);   // would round to infinity
+    }
+    if (bits < 0x38800000u)
+    {
+        // subnormal halves are multiples of 2^-24 (scaling by a power of two is exact)
+        float magnitude;
+        std::memcpy(&magnitude, &bits, sizeof(magnitude));
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(magnitude * 16777216.f)));
+    }
+
+    // rebias the exponent (127 -> 15) and round away the lower 13 bits of the mantissa, a carry correctly increments the exponent
+    uint32_t half = (bits - 0x38000000u) >> 13;
+    uint32_t rest = bits & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u) != 0))
+    {
+        ++half;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+inline float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+
+    if (exponent == 0)
+    {
+        float magnitude = static_cast<float>(mantissa) * (1.f / 16777216.f);
+        return sign != 0 ? -magnitude : magnitude;
+    }
+
+    uint32_t bits = sign | (exponent == 0x1Fu ? 0x7F800000u : (exponent + 112u) << 23) | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+struct FloatSums
+{
+    static constexpr AccumulationFormat FORMAT = AccumulationFormat::Float;
+    static constexpr size_t BYTES_PER_PIXEL = sizeof(glm::vec3);
+
+    AccumulationVector<glm::vec3> sums;
+
+    void Resize(size_t numPixels) { sums.resize(numPixels); }
+    void Clear(size_t index, size_t count) { std::memset(&sums[index], 0, count * sizeof(glm::vec3)); }
+    glm::vec3 Get(size_t index, uint32_t) const { return sums[index]; }
+    void Add(size_t index, uint32_t, const glm::vec3& color) { sums[index] += color; }
+    void Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const;
+    uint64_t Hash(uint64_t hash) const;
+};
+
+/// Means instead of sums, as the sum of many passes would lose the precision of a half float quickly. Once a pass
+/// changes the mean by less than half a unit in the last place (about 1/2000 of the mean), the pixel stops changing.
+struct HalfMeans
+{
+    static constexpr AccumulationFormat FORMAT = AccumulationFormat::Half;
+    static constexpr size_t BYTES_PER_PIXEL = 3 * sizeof(uint16_t);
+
+    struct Pixel
+    {
+        uint16_t r;
+        uint16_t g;
+        uint16_t b;
+    };
+    AccumulationVector<Pixel> means;
+
+    glm::vec3 GetMean(size_t index, uint32_t) const
+    {
+        const Pixel& p = means[index];
+        return glm::vec3(HalfToFloat(p.r), HalfToFloat(p.g), HalfToFloat(p.b));
+    }
+
+    void Resize(size_t numPixels) { means.resize(numPixels); }
+    void Clear(size_t index, size_t count) { std::memset(&means[index], 0, count * sizeof(Pixel)); }
+    glm::vec3 Get(size_t index, uint32_t passes) const { return GetMean(index, passes) * static_cast<float>(passes); }
+
+    void Add(size_t index, uint32_t passes, const glm::vec3& color)
+    {
+        glm::vec3 mean = GetMean(index, passes);
+        mean += (color - mean) * (1.f / static_cast<float>(passes + 1));
+        means[index] = Pixel{ FloatToHalf(mean.r), FloatToHalf(mean.g), FloatToHalf(mean.b) };
+    }
+
+    void Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const;
+    uint64_t Hash(uint64_t hash) const;
+};
+
+struct DoubleSums
+{
+    static constexpr AccumulationFormat FORMAT = AccumulationFormat::Double;
+    static constexpr size_t BYTES_PER_PIXEL = sizeof(glm::dvec3);
+
+    AccumulationVector<glm::dvec3> sums;
+
+    glm::vec3 GetMean(size_t index, uint32_t passes) const
+    {
+        return passes > 0 ? glm::vec3(sums[index] / static_cast<double>(passes)) : glm::vec3(0.f);
+    }
+
+    void Resize(size_t numPixels) { sums.resize(numPixels); }
+    void Clear(size_t index, size_t count) { std::memset(&sums[index], 0, count * sizeof(glm::dvec3)); }
+    glm::vec3 Get(size_t index, uint32_t) const { return glm::vec3(sums[index]); }
+    void Add(size_t index, uint32_t, const glm::vec3& color) { sums[index] += glm::dvec3(color); }
+    void Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const;
+    uint64_t Hash(uint64_t hash) const;
+};
+
+/// Kahan summation: the rounding error of every addition is kept and subtracted from the next color
+struct KahanSums
+{
+    static constexpr AccumulationFormat FORMAT = AccumulationFormat::Kahan;
+    static constexpr size_t BYTES_PER_PIXEL = 2 * sizeof(glm::vec3);
+
+    struct Pixel
+    {
+        glm::vec3 sum;
+        glm::vec3 compensation;
+    };
+    AccumulationVector<Pixel> sums;
+
+    glm::vec3 GetMean(size_t index, uint32_t passes) const
+    {
+        return Get(index, passes) * (passes > 0 ? 1.f / static_cast<float>(passes) : 0.f);
+    }
+
+    void Resize(size_t numPixels) { sums.resize(numPixels); }
+    void Clear(size_t index, size_t count) { std::memset(&sums[index], 0, count * sizeof(Pixel)); }
+    glm::vec3 Get(size_t index, uint32_t) const { return sums[index].sum - sums[index].compensation; }
+
+    void Add(size_t index, uint32_t, const glm::vec3& color)
+    {
+        Pixel& p = sums[index];
+        glm::vec3 y = color - p.compensation;
+        glm::vec3 t = p.sum + y;
+        p.compensation = (t - p.sum) - y;
+        p.sum = t;
+    }
+
+    void Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const;
+    uint64_t Hash(uint64_t hash) const;
+};
+
+struct PlanarSums
+{
+    static constexpr AccumulationFormat FORMAT = AccumulationFormat::Planar;
+    static constexpr size_t BYTES_PER_PIXEL = 3 * sizeof(float);
+
+    AccumulationVector<float> planes[3];
+
+    void Resize(size_t numPixels)
+    {
+        for (auto& plane : planes)
+        {
+            plane.resize(numPixels);
+        }
+    }
+
+    void Clear(size_t index, size_t count)
+    {
+        for (auto& plane : planes)
+        {
+            std::memset(&plane[index], 0, count * sizeof(float));
+        }
+    }
+
+    glm::vec3 Get(size_t index, uint32_t) const { return glm::vec3(planes[0][index], planes[1][index], planes[2][index]); }
+
+    void Add(size_t index, uint32_t, const glm::vec3& color)
+    {
+        planes[0][index] += color.r;
+        planes[1][index] += color.g;
+        planes[2][index] += color.b;
+    }
+
+    void Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const;
+    uint64_t Hash(uint64_t hash) const;
+};
+
+/// The accumulation buffer of one format, which forwards to the storage
+template <typename Storage>
+class TypedAccumulationBuffer final : public AccumulationBuffer
+{
+public:
+    virtual AccumulationFormat GetFormat() const override { return Storage::FORMAT; }
+    virtual size_t GetBytesPerPixel() const override { return Storage::BYTES_PER_PIXEL; }
+    virtual int GetPixelAlignment() const override { return GetCacheLinePixels(Storage::BYTES_PER_PIXEL); }
+
+    virtual void Resize(size_t numPixels) override { m_storage.Resize(numPixels); }
+    virtual void Clear(size_t index, size_t count) override { m_storage.Clear(index, count); }
+    virtual glm::vec3 Get(size_t index, uint32_t passes) const override { return m_storage.Get(index, passes); }
+    virtual void Add(size_t index, uint32_t passes, const glm::vec3& color) override { m_storage.Add(index, passes, color); }
+
+    virtual void Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const override
+    {
+        m_storage.Resolve(index, passes, pixels, count, format);
+    }
+
+    virtual uint64_t Hash(uint64_t hash) const override { return m_storage.Hash(hash); }
+
+    Storage& GetStorage() { return m_storage; }
+
+private:
+    Storage m_storage;
+};
+
+/// Storage of a buffer whose format is Storage::FORMAT, for loops over many pixels that dispatch on GetFormat() once
+/// instead of calling the virtual functions per pixel
+template <typename Storage>
+Storage& GetStorage(AccumulationBuffer& buffer)
+{
+    return static_cast<TypedAccumulationBuffer<Storage>&>(buffer).GetStorage();
+}
+
+std::unique_ptr<AccumulationBuffer> CreateAccumulationBuffer(AccumulationFormat format);
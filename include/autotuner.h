@@ -0,0 +1,50 @@
+#pragma once
+
+/// Picks the tile size and the number of render threads from measurements of complete refinement passes. Every candidate
+/// is rendered for a few passes: first the tile sizes with all threads, then the best tile size with fewer and fewer threads
+/// as long as that does not cost throughput (e.g. because of SMT contention or saturated memory bandwidth).
+class AutoTuner
+{
+public:
+    struct Config
+    {
+        int tileSize;
+        int numThreads;
+    };
+
+    explicit AutoTuner(int maxThreads = 1);
+
+    /// Starts over with all candidates
+    void Reset(int maxThreads);
+
+    bool IsDone() const { return m_done; }
+
+    /// Configuration to measure next, or the chosen one once done
+    const Config& GetConfig() const { return m_config; }
+
+    /// Measurement of a pass rendered with the current configuration: wall time, time the threads spent in tiles and the
+    /// number of pixels rendered. Returns true if the configuration changed.
+    bool AddPass(double seconds, double busySeconds, double numPixels);
+
+private:
+    struct Candidate
+    {
+        Config config;
+        double seconds;
+        double busySeconds;
+        double numPixels;
+
+        double GetThroughput() const { return numPixels / seconds; }
+        double GetIdleFraction() const { return 1.0 - busySeconds / (seconds * config.numThreads); }
+    };
+
+    void FinishCandidate();
+
+    int m_maxThreads;
+    Config m_config;
+    Candidate m_current;    ///< sums over the measured passes of m_config
+    Candidate m_best;
+    int m_numPasses;
+    int m_tileSizeIndex;    ///< candidate tile size, past the last one while reducing the threads
+    bool m_done;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "hitable.h"
+
+#include <vector>
+
+/// Bounding volume hierarchy over a set of hitables (binary tree with median splits, stored as flat array)
+class Bvh : public Hitable
+{
+public:
+    Bvh(const std::vector<Hitable*>& hitables);
+    Bvh() = delete;
+
+    virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const override;
+
+    virtual Aabb BoundingBox() const override;
+
+private:
+    struct Node
+    {
+        Aabb box;
+        int offset;     ///< leaf: index of first primitive, interior node: index of second child (first child follows the node)
+        int count;      ///< number of primitives (0 for interior nodes)
+        int axis;       ///< split axis of interior nodes for front-to-back traversal
+    };
+
+    int BuildRecursive(int begin, int end);
+
+    std::vector<Node> m_nodes;
+    std::vector<Hitable*> m_primitives;
+};
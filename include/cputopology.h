@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+/// CPUs per NUMA node, read from /sys/devices/system/node on Linux (restricted to the CPUs the process may run on).
+/// Elsewhere, or if the information is not available, there is a single node with all hardware threads.
+class CpuTopology
+{
+public:
+    static CpuTopology Detect();
+
+    int GetNumNodes() const { return static_cast<int>(m_nodeCpus.size()); }
+    const std::vector<int>& GetNodeCpus(int node) const { return m_nodeCpus[node]; }
+
+private:
+    CpuTopology() = default;
+
+    std::vector<std::vector<int>> m_nodeCpus;   ///< never empty, no node without CPUs
+};
+
+/// Restricts the calling thread to one CPU, returns false if that is not supported or failed
+bool PinCurrentThread(int cpu);
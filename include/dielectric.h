@@ -10,12 +10,13 @@ public:
     Dielectric(float ri);
     Dielectric() = delete;
 
-    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& attenuation, Ray& scattered) const override;
+    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const override;
 
 private:
     bool Refract(const glm::vec3& v, const glm::vec3& n, float niOverNt, glm::vec3& refracted) const;
 
-    float Schlick(float cosine, float refractiveIndex) const;
+    float Schlick(float cosine) const;
 
     float m_refractiveIndex;
+    float m_r0;    ///< reflectance at normal incidence for Schlick's approximation
 };
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "commonheader.h"
+
+#include "material.h"
+
+/// Emissive material radiating uniformly into all directions (does not scatter light)
+class DiffuseLight : public Material
+{
+public:
+    DiffuseLight(const glm::vec3& emission);
+    DiffuseLight() = delete;
+
+    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const override;
+
+    virtual glm::vec3 Emitted(const Ray& inRay, const HitRecord& rec) const override { return m_emission; }
+
+    glm::vec3 GetEmission() const { return m_emission; }
+
+private:
+    glm::vec3 m_emission;
+};
@@ -2,8 +2,10 @@
 
 #include "commonheader.h"
 
+#include "aabb.h"
 #include "ray.h"
 
+class Hitable;
 class Material;
 
 struct HitRecord
@@ -12,10 +14,36 @@ struct HitRecord
     glm::vec3 p;
     glm::vec3 normal;
     const Material* material;
+    const Hitable* object;    ///< the primitive that was hit (for identifying lights)
+
+    // surface parameterization for texturing (see Hitable::ComputeTextureCoordinates)
+    glm::vec2 uv;
+    glm::vec3 dpdu;
+    glm::vec3 dpdv;
+
+    // screen-space footprint at the hit point (zero if the ray has no differentials)
+    glm::vec3 dpdx;
+    glm::vec3 dpdy;
+    glm::vec2 duvdx;
+    glm::vec2 duvdy;
+
+    /// Computes the footprint from the differentials of the ray that produced the hit. duvdx and duvdy are only solved
+    /// for textured hits (after ComputeTextureCoordinates, as dpdu and dpdv are not set otherwise) and stay zero else.
+    void ComputeDifferentials(const Ray& r, bool textured);
 };
 
 class Hitable
 {
 public:
     virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const = 0;
+
+    virtual Aabb BoundingBox() const = 0;
+
+    /// Sets uv, dpdu and dpdv of a hit record for this primitive (only required for textured materials)
+    virtual void ComputeTextureCoordinates(HitRecord& rec) const
+    {
+        rec.uv = glm::vec2(0.f);
+        rec.dpdu = glm::vec3(0.f);
+        rec.dpdv = glm::vec3(0.f);
+    }
 };
@@ -15,6 +15,8 @@ public:
 
     virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const; 
 
+    virtual Aabb BoundingBox() const;
+
 private:
     std::vector<Hitable*> m_list;
 };
@@ -3,16 +3,26 @@
 #include "commonheader.h"
 
 #include "material.h"
+#include "texture.h"
 
 /// Diffuse material
 class Lambertian : public Material
 {
 public:
     Lambertian(const glm::vec3& a);
+    Lambertian(const Texture* albedoTexture);
     Lambertian() = delete;
 
-    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& attenuation, Ray& scattered) const override;
+    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const override;
+
+    virtual bool IsTextured() const override { return m_albedoTexture != nullptr; }
+    virtual bool IsSpecular() const override { return false; }
+    virtual glm::vec3 Evaluate(const Ray& inRay, const HitRecord& rec, const glm::vec3& wi) const override;
+    virtual float Pdf(const Ray& inRay, const HitRecord& rec, const glm::vec3& wi) const override;
 
 private:
+    glm::vec3 Albedo(const HitRecord& rec) const;
+
     glm::vec3 m_albedo;
+    const Texture* m_albedoTexture;     ///< replaces the constant albedo if set
 };
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "aabb.h"
+#include "lightsampler.h"
+
+#include <unordered_map>
+#include <vector>
+
+/// Light hierarchy for many-light sampling: each node bounds the position, emission directions and power of its lights.
+/// A light is selected by traversing the tree from the root and choosing a child stochastically with probability
+/// proportional to its estimated contribution to the shading point, so selection cost is logarithmic in the number of lights.
+class LightBvh : public LightSampler
+{
+public:
+    LightBvh(const std::vector<const Sphere*>& lights);
+    LightBvh() = delete;
+
+    size_t GetNumLights() const { return m_lights.size(); }
+
+    virtual const Sphere* SampleLight(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const override;
+    virtual float Pmf(const glm::vec3& p, const glm::vec3& n, const Hitable* light) const override;
+
+private:
+    struct Node
+    {
+        Aabb bounds;
+        glm::vec3 axis;     ///< orientation cone around which all normals of the emitters lie ...
+        float thetaO;       ///< ... with this opening angle
+        float thetaE;       ///< maximum angle of emission around each normal
+        float power;        ///< total emitted power (luminance)
+        int secondChild;    ///< index of the second child for interior nodes (the first child follows the node)
+        int lightIndex;     ///< index of the light for leaf nodes, -1 for interior nodes
+        int parent;         ///< index of the parent node, -1 for the root
+    };
+
+    int BuildRecursive(std::vector<int>& lightIndices, int begin, int end, int parent);
+
+    /// Conservative estimate of the contribution of all lights below the node to the shading point
+    float Importance(const glm::vec3& p, const glm::vec3& n, const Node& node) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<const Sphere*> m_lights;
+    std::vector<int> m_leafOfLight;
+    std::unordered_map<const Hitable*, int> m_lightIndices;
+};
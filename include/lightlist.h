@@ -0,0 +1,24 @@
+#pragma once
+
+#include "lightsampler.h"
+
+#include <vector>
+
+/// Selects all lights with equal probability
+class LightList : public LightSampler
+{
+public:
+    LightList() = default;
+
+    void AddToList(const Sphere* light);
+
+    void clear();
+
+    size_t GetNumLights() const { return m_lights.size(); }
+
+    virtual const Sphere* SampleLight(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const override;
+    virtual float Pmf(const glm::vec3& p, const glm::vec3& n, const Hitable* light) const override;
+
+private:
+    std::vector<const Sphere*> m_lights;
+};
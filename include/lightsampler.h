@@ -0,0 +1,20 @@
+#pragma once
+
+#include "commonheader.h"
+
+class Hitable;
+class Sphere;
+
+/// Strategy for selecting one of the emissive spheres of a scene for next-event estimation
+class LightSampler
+{
+public:
+    virtual ~LightSampler() = default;
+
+    /// Selects a light for the shading point p with normal n using the random number u,
+    /// returns nullptr if there is no light and sets pmf to the probability of the selection
+    virtual const Sphere* SampleLight(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const = 0;
+
+    /// Probability with which SampleLight() selects the given emissive object (all of them must be registered)
+    virtual float Pmf(const glm::vec3& p, const glm::vec3& n, const Hitable* light) const = 0;
+};
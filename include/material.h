@@ -4,12 +4,24 @@
 
 #include "ray.h"
 #include "hitable.h"
+#include "sampler.h"
 
 class Material
 {
 public:
-    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& attenuation, Ray& scattered) const = 0;
-protected:
-    /// simple (and inefficient) uniform sampling of points in the unit sphere
-    glm::vec3 RandomInUnitSphere() const;
+    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const = 0;
+
+    /// Radiance emitted at the hit point (black for non-emissive materials)
+    virtual glm::vec3 Emitted(const Ray& inRay, const HitRecord& rec) const { return glm::vec3(0.f); }
+
+    /// Textured materials need texture coordinates and their screen-space derivatives in the hit record
+    virtual bool IsTextured() const { return false; }
+
+    /// Materials without a closed-form BSDF (mirrors, glass) are specular: they are not light sampled
+    virtual bool IsSpecular() const { return true; }
+
+    /// BSDF times cosine for the (normalized) outgoing direction wi, only needed for non-specular materials
+    virtual glm::vec3 Evaluate(const Ray& inRay, const HitRecord& rec, const glm::vec3& wi) const { return glm::vec3(0.f); }
+    /// Solid angle density with which Scatter() generates the direction wi, only needed for non-specular materials
+    virtual float Pdf(const Ray& inRay, const HitRecord& rec, const glm::vec3& wi) const { return 0.f; }
 };
@@ -10,9 +10,10 @@ public:
     Metal(const glm::vec3& a, float fuzziness = 0.f);
     Metal() = delete;
 
-    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& attenuation, Ray& scattered) const override;
+    virtual bool Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const override;
 
 private:
     glm::vec3 m_albedo;
     float m_fuzziness;
+    float m_cosFuzzCone;    ///< cosine of the opening angle of the cone of fuzzy reflections
 };
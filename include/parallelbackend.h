@@ -0,0 +1,54 @@
+#pragma once
+
+#include "renderthreadpool.h"
+
+// The parallel runtime behind the renderer is chosen at build time (PARALLEL_BACKEND in CMake): the own thread pool (default),
+// OpenMP or the C++17 parallel algorithms. All of them have the interface of RenderThreadPool that the renderer uses, i.e.
+// tile batches, parallel loops, queued tasks and the number of (active) threads, so they can be compared without changes
+// to the renderer.
+
+#if defined(PARALLEL_BACKEND_OPENMP) || defined(PARALLEL_BACKEND_STDPAR)
+
+// runtime of the compiler: tiles, chunks of loops and queued tasks are all scheduled dynamically (OpenMP: schedule(dynamic),
+// parallel algorithms: one std::for_each(std::execution::par) item per thread taking indices from an atomic counter),
+// queued tasks only start once they are waited for, there is a single NUMA node
+class ParallelRuntime
+{
+public:
+    // numThreads includes the submitting thread (the parallel algorithms use all hardware threads, but at most numThreads
+    // take work), topology awareness is not supported
+    ParallelRuntime(int numThreads = std::thread::hardware_concurrency(), bool topologyAware = false);
+
+    ParallelRuntime(const ParallelRuntime&) = delete;
+    ParallelRuntime& operator=(const ParallelRuntime&) = delete;
+
+    void AddTask(RenderTask r) { m_tasks.push_back(r); }
+    void WaitForTasks();
+    void SetTaskCounter(int c) { m_tasks.reserve(static_cast<size_t>(c)); }
+
+    void RunTileBatch(const TileBatch& batch);
+    void ParallelFor(int begin, int end, const std::function<void(int)>& function, int grainSize = 1);
+
+    size_t GetNumThreads() const { return static_cast<size_t>(m_numThreads); }
+    void SetNumActiveThreads(int numThreads);
+    size_t GetNumActiveThreads() const { return static_cast<size_t>(m_numActiveThreads); }
+    int GetNumNodes() const { return 1; }
+
+    static const char* GetName();
+
+private:
+    // calls function(i) for all i in [0, count) on the active threads
+    void Run(int count, const std::function<void(int)>& function);
+
+    int m_numThreads;
+    int m_numActiveThreads;
+    std::vector<RenderTask> m_tasks;
+};
+
+using ParallelBackend = ParallelRuntime;
+
+#else
+
+using ParallelBackend = RenderThreadPool;
+
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "commonheader.h"
+
+#include "aabb.h"
+
+#include <atomic>
+#include <vector>
+
+/// Quadtree over the square of cylindrical coordinates (an equal-area mapping of the sphere of directions) that
+/// approximates the incident radiance at a region of the scene ("Practical Path Guiding", Mueller et al., 2017)
+class DirectionalQuadtree
+{
+public:
+    DirectionalQuadtree();
+
+    /// Samples a direction proportional to the learned distribution (uniformly if nothing was learned yet)
+    glm::vec3 Sample(glm::vec2 u, float& pdf) const;
+    float Pdf(const glm::vec3& direction) const;
+
+    /// Splats a radiance estimate for the direction (thread-safe)
+    void Record(const glm::vec3& direction, float value);
+
+    /// Propagates the recorded values from the leaves to the inner nodes
+    void Build();
+
+    /// Adapts the structure to the energy distribution of the (built) tree previous and clears all records:
+    /// cells holding more than the given fraction of the energy are subdivided, others are collapsed
+    void Refine(const DirectionalQuadtree& previous, float subdivisionThreshold, int maxDepth);
+
+    uint32_t GetNumSamples() const { return m_numSamples.load(std::memory_order_relaxed); }
+    float GetTotal() const;
+
+    DirectionalQuadtree(const DirectionalQuadtree& other);
+    DirectionalQuadtree& operator=(const DirectionalQuadtree& other);
+
+private:
+    struct Node
+    {
+        Node();
+        Node(const Node& other);
+        Node& operator=(const Node& other);
+
+        /// Energy of a quadrant as float
+        float Energy(int quadrant) const;
+
+        std::atomic<uint64_t> sum[4];   ///< energy of the four quadrants in fixed point (child i covers (i & 1, i >> 1) in the unit square)
+        uint32_t children[4];           ///< index of the child node of each quadrant (0 for leaf quadrants)
+    };
+
+    uint64_t BuildRecursive(uint32_t nodeIndex);
+    void RefineRecursive(const DirectionalQuadtree& previous, uint32_t previousIndex, uint32_t nodeIndex, float fraction, float total, int depth, float subdivisionThreshold, int maxDepth);
+
+    std::vector<Node> m_nodes;
+    std::atomic<uint32_t> m_numSamples;
+};
+
+/// Spatial binary tree over the scene bounds whose leaves each hold a directional quadtree for sampling
+/// (learned in the previous training iteration) and one for recording (learned in the current one)
+class GuidingField
+{
+public:
+    GuidingField(const Aabb& bounds);
+    GuidingField() = delete;
+
+    struct Leaf
+    {
+        DirectionalQuadtree sampling;
+        DirectionalQuadtree building;
+    };
+
+    /// Leaf for a point in the scene (points outside of the bounds are clamped)
+    Leaf& GetLeaf(const glm::vec3& p);
+
+    /// Ends a training iteration: splits spatial leaves that received many samples and turns the recorded
+    /// distributions into the sampling distributions of the next iteration
+    void EndIteration();
+
+    int GetIteration() const { return m_iteration; }
+    size_t GetNumLeaves() const { return m_leaves.size(); }
+
+private:
+    struct Node
+    {
+        int children[2];    ///< child nodes (-1 for leaves)
+        int axis;
+        int leafIndex;      ///< index of the leaf data (-1 for inner nodes)
+    };
+
+    void SplitRecursive(int nodeIndex, int depth, uint32_t threshold);
+    void SplitLeaf(int nodeIndex, int depth, uint32_t numSamples, uint32_t threshold);
+
+    Aabb m_bounds;
+    std::vector<Node> m_nodes;
+    std::vector<Leaf> m_leaves;
+    int m_iteration;
+};
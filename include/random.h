@@ -1,18 +1,102 @@
 #pragma once
 
-#include <stdlib.h>
+#include <cstdint>
 
-// #TODO: replace by a thread-safe and fast random number generation
-/// Returns a pseudo-random float in the range [0, 1)
-inline float GetNextRandom()
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/// Mixes a 64-bit value into a well distributed hash (finalizer of SplitMix64), used for seeding
+inline uint64_t MixBits(uint64_t v)
+{
+    v ^= v >> 30;
+    v *= 0xBF58476D1CE4E5B9ull;
+    v ^= v >> 27;
+    v *= 0x94D049BB133111EBull;
+    v ^= v >> 31;
+    return v;
+}
+
+/// PCG32 random number generator (O'Neill, "PCG: A Family of Simple Fast Space-Efficient Statistically Good
+/// Algorithms for Random Number Generation", 2014): 16 bytes of state, so each path can carry its own generator
+/// instead of sharing hidden global state between render threads
+class Pcg32
+{
+public:
+    Pcg32(uint64_t seed = 0x853C49E6748FEA9Bull, uint64_t stream = 0xDA3E39CB94B95BDBull)
+    {
+        Seed(seed, stream);
+    }
+
+    void Seed(uint64_t seed, uint64_t stream)
+    {
+        m_state = 0u;
+        m_increment = (stream << 1u) | 1u;
+        NextUInt();
+        m_state += seed;
+        NextUInt();
+    }
+
+    uint32_t NextUInt()
+    {
+        uint64_t oldState = m_state;
+        m_state = oldState * 6364136223846793005ull + m_increment;
+        uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+        uint32_t rotation = static_cast<uint32_t>(oldState >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1u) & 31u));
+    }
+
+    /// Returns a pseudo-random float in the range [0, 1)
+    float NextFloat()
+    {
+        // use the upper 24 bits, so the result is exactly representable and strictly below one
+        return static_cast<float>(NextUInt() >> 8) * (1.f / 16777216.f);
+    }
+
+private:
+    uint64_t m_state;
+    uint64_t m_increment;
+};
+
+/// 32-bit integer hash with low bias (Wellons' "lowbias32"), only uses operations that exist for SIMD lanes
+inline uint32_t HashUInt(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+/// Eight counter-based random streams evaluated together: out[i] = Hash(key, counter + i) in [0, 1).
+/// Uses one AVX2 instruction sequence for all lanes when compiled with AVX2 (the scalar loop gives identical results).
+inline void RandomFloats8(uint32_t key, uint32_t counter, float* out)
 {
-#if __linux
-    return drand48();
-#elif WIN32
-    static constexpr float max_rcp = 1.f / (static_cast<float>(RAND_MAX) + 1.f);
+#if defined(__AVX2__)
+    const __m256i c0 = _mm256_set1_epi32(0x7feb352d);
+    const __m256i c1 = _mm256_set1_epi32(static_cast<int>(0x846ca68bu));
+
+    auto hash = [&](__m256i x)
+        {
+            x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+            x = _mm256_mullo_epi32(x, c0);
+            x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+            x = _mm256_mullo_epi32(x, c1);
+            x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+            return x;
+        };
+
+    __m256i x = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(counter)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    x = hash(_mm256_xor_si256(hash(x), _mm256_set1_epi32(static_cast<int>(key))));
 
-    return static_cast<float>(rand()) * max_rcp;
+    // upper 24 bits, as for Pcg32::NextFloat()
+    __m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), _mm256_set1_ps(1.f / 16777216.f));
+    _mm256_storeu_ps(out, f);
 #else
-    static_assert(false, "Unsupported platform");
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        out[i] = static_cast<float>(HashUInt(HashUInt(counter + i) ^ key) >> 8) * (1.f / 16777216.f);
+    }
 #endif
 }
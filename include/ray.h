@@ -8,6 +8,7 @@ public:
     Ray(const glm::vec3& origin, const glm::vec3& direction)
     : m_origin(origin)
     , m_direction(direction)
+    , m_hasDifferentials(false)
     { }
 
     Ray() = delete;
@@ -25,7 +26,29 @@ public:
 
     glm::vec3 PointAt(float t) const { return m_origin + t * m_direction; }
 
+    /// Ray differentials: offset rays for the neighboring pixels in x and y (for texture filtering)
+    bool HasDifferentials() const { return m_hasDifferentials; }
+    void SetDifferentials(const glm::vec3& rxOrigin, const glm::vec3& rxDirection, const glm::vec3& ryOrigin, const glm::vec3& ryDirection)
+    {
+        m_rxOrigin = rxOrigin;
+        m_rxDirection = rxDirection;
+        m_ryOrigin = ryOrigin;
+        m_ryDirection = ryDirection;
+        m_hasDifferentials = true;
+    }
+
+    const glm::vec3& RxOrigin() const { return m_rxOrigin; }
+    const glm::vec3& RxDirection() const { return m_rxDirection; }
+    const glm::vec3& RyOrigin() const { return m_ryOrigin; }
+    const glm::vec3& RyDirection() const { return m_ryDirection; }
+
 private:
     glm::vec3 m_origin;
     glm::vec3 m_direction;
+
+    bool m_hasDifferentials;
+    glm::vec3 m_rxOrigin;
+    glm::vec3 m_rxDirection;
+    glm::vec3 m_ryOrigin;
+    glm::vec3 m_ryDirection;
 };
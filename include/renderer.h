@@ -2,17 +2,48 @@
 
 #include "commonheader.h"
 
+#include "accumulationbuffer.h"
+#include "alignedallocator.h"
+#include "autotuner.h"
 #include "camera.h"
 #include "hitablelist.h"
+#include "lightsampler.h"
+#include "sampler.h"
 #include "ray.h"
-#include "renderthreadpool.h"
+#include "parallelbackend.h"
 #include "viewport.h"
 
+#include <atomic>
+#include <memory>
+
+class DirectionalQuadtree;
+class GuidingField;
+
+/// Order in which the tiles are issued to the thread pool (and thus roughly the order in which they are rendered)
+enum class TileOrder
+{
+    Scanline,   ///< row by row
+    Morton,     ///< Z-order curve
+    Hilbert     ///< Hilbert curve, consecutive tiles are always neighbors
+};
+
+/// Rectangle of the image in buffer coordinates (rows from the top)
+struct Tile
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
 class Renderer final
 {
 public:
     Renderer() = delete;
-    Renderer(const Viewport& v);
+    /// Topology aware: render threads are pinned to CPUs and spread over the NUMA nodes, each node renders a fixed band of
+    /// tiles (first with the threads of that node) and clears it, so the band's framebuffer pages are local to that node
+    Renderer(const Viewport& v, int numThreads = std::thread::hardware_concurrency(), bool topologyAware = false);
+    ~Renderer();
 
     Trackball& GetTrackball() { return m_trackball; }
     const Trackball& GetTrackball() const { return m_trackball; }
@@ -22,41 +53,228 @@ public:
     const Viewport& GetViewport() const { return m_viewport; }
     void SetViewport(const Viewport& viewport) { m_viewport = viewport; }
 
+    /// Lights for next-event estimation (nullptr: emitters are only found by chance)
+    const LightSampler* GetLightSampler() const { return m_lightSampler; }
+    void SetLightSampler(const LightSampler* lightSampler) { m_lightSampler = lightSampler; }
+
+    /// Explicit light sampling with shadow rays at diffuse bounces, combined with BSDF sampling by MIS
+    bool GetNextEventEstimation() const { return m_nextEventEstimation; }
+    void SetNextEventEstimation(bool enabled) { m_nextEventEstimation = enabled; }
+
+    /// Scale of the background gradient (which acts as an environment light)
+    float GetBackgroundIntensity() const { return m_backgroundIntensity; }
+    void SetBackgroundIntensity(float intensity) { m_backgroundIntensity = intensity; }
+
+    /// Online path guiding: incident radiance is learned in a spatial-directional tree while rendering
+    /// (progressively over refinement iterations) and mixed with BSDF sampling at non-specular surfaces
+    bool GetPathGuiding() const { return m_pathGuiding; }
+    void SetPathGuiding(bool enabled) { m_pathGuiding = enabled; }
+
+    /// Source of the random numbers for pixel positions and all bounces
+    SamplerType GetSamplerType() const { return m_samplerType; }
+    void SetSamplerType(SamplerType type) { m_samplerType = type; }
+
+    /// Adaptive sampling: pixels stop receiving samples once the standard error of their displayed value drops below
+    /// the threshold (0 disables), tasks whose pixels are all converged are not scheduled anymore
+    float GetAdaptiveSampling() const { return m_adaptiveThreshold; }
+    void SetAdaptiveSampling(float threshold);
+
+    /// Square tiles are the unit of work of the render threads, tiles whose size is a multiple of the pixel alignment of the
+    /// accumulation format (16 pixels, 32 for half floats) start on cache lines of the accumulation buffers (so no two threads
+    /// write to the same line)
+    int GetTileSize() const { return m_tileSize; }
+    void SetTileSize(int size);
+
+    TileOrder GetTileOrder() const { return m_tileOrder; }
+    void SetTileOrder(TileOrder order);
+
+    /// Persistent workers take the tiles of a refinement iteration from an atomic counter (the default), otherwise every
+    /// tile is queued as a separate task
+    bool GetAtomicTileDispatch() const { return m_atomicTileDispatch; }
+    void SetAtomicTileDispatch(bool enabled) { m_atomicTileDispatch = enabled; }
+
+    /// Foveated scheduling: every pass issues the tiles by their distance from the focus point, and while the tiles around it
+    /// are still refining, tiles further away only get every 2nd, 4th or 8th pass. Afterwards all tiles get every pass.
+    bool GetFoveation() const { return m_foveation; }
+    void SetFoveation(bool enabled);
+
+    /// Focus point in pixels from the upper left (the center of the image by default), may be called from any thread and
+    /// takes effect with the next pass
+    glm::ivec2 GetFocusPoint() const { return glm::ivec2(m_focusX.load(std::memory_order_relaxed), m_focusY.load(std::memory_order_relaxed)); }
+    void SetFocusPoint(const glm::ivec2& point);
+
+    /// Time in seconds that a Render() call may take (0: one refinement iteration per call). Cheap passes are then rendered
+    /// several times per call, expensive ones are split by tiles over several calls. The time of the tiles is predicted from
+    /// their render times in previous passes.
+    double GetFrameBudget() const { return m_frameBudget; }
+    void SetFrameBudget(double seconds) { m_frameBudget = glm::max(seconds, 0.0); }
+
+    /// Chooses the tile size and the number of threads that render (fewer if more threads do not increase the throughput)
+    /// by measuring the first refinement passes with each candidate, the chosen configuration is logged
+    bool GetAutoTuning() const { return m_autoTuning; }
+    void SetAutoTuning(bool enabled);
+
+    /// Storage of the accumulated colors (float sums by default), changing it clears the framebuffer
+    AccumulationFormat GetAccumulationFormat() const { return m_accumulationBuffer->GetFormat(); }
+    void SetAccumulationFormat(AccumulationFormat format);
+
+    /// Format of the pixels that Render() writes (RGBA by default), so they can be copied to the display as they are
+    PixelFormat GetPixelFormat() const { return m_pixelFormat; }
+    void SetPixelFormat(PixelFormat format);
+
+    /// Logs time, variance and efficiency per refinement iteration (at powers of two)
+    void SetLogStatistics(bool enabled) { m_logStatistics = enabled; }
+
     void ClearFramebuffer();
-    void Render(const Hitable& world, uint32_t* pixelData);
+
+    /// Renders a refinement iteration (or as much as fits into the frame budget) and resolves the image, returns false if the
+    /// pass was cancelled (the pixels are not updated then). Tiles that did not change since they were last resolved into the
+    /// same pixel buffer are not written again, so the buffer has to keep its content between the calls.
+    bool Render(const Hitable& world, uint32_t* pixelData);
+
+    /// False once the maximum number of refinement iterations is reached or all pixels are converged (further passes
+    /// only resolve the same image)
+    bool IsRefining() const;
+
+    /// Aborts the pass in flight (may be called from any thread): tiles that have not been written back yet discard their
+    /// samples and the remaining tiles are skipped. Samples of tiles that were already written back stay valid.
+    void CancelFrame() { m_frameGeneration.fetch_add(1, std::memory_order_relaxed); }
+
+    /// Hash of the accumulated image and the sample counts. Every pixel sample is seeded by its pixel and index and
+    /// accumulated by one task, so the hash does not depend on the number of threads or the order of the tasks.
+    uint64_t GetImageHash() const;
+
+    size_t GetNumThreads() const { return m_threadPool.GetNumThreads(); }
 
 protected:
     friend struct RenderTask;
 
-    void RenderLines(int min, int max, const Camera& camera, const Hitable& world, glm::vec3 lowerLeft, glm::vec3 vertical, glm::vec3 horizontal);
+    void RenderTile(int tileIndex, const Camera& camera, const Hitable& world, glm::vec3 lowerLeft, glm::vec3 vertical, glm::vec3 horizontal);
+
+    // renders the tile into the storage of the accumulation buffer's format, so the per-pixel accesses are direct calls
+    template <typename Storage>
+    void RenderTile(Storage& accumulation, int tileIndex, const Camera& camera, const Hitable& world, glm::vec3 lowerLeft, glm::vec3 vertical, glm::vec3 horizontal);
 
 private:
     // helper functions
 
     glm::vec3 BackgroundColor(const Ray& r) const;
     glm::vec3 ComputeFirstHitColor(const Ray& r, const Hitable& world) const;
-    glm::vec3 ComputeColor(const Ray& r, const Hitable& world, int depth = 0) const;
-
-    void GammaCorrection(glm::vec3& color) const {  color = glm::sqrt(color); }
+    glm::vec3 ComputeColor(const Ray& r, const Hitable& world, Sampler& sampler) const;
+    glm::vec3 SampleDirectLight(const Ray& r, const HitRecord& rec, const Hitable& world, const DirectionalQuadtree* guide, Sampler& sampler) const;
 
     void SetAccumulatedImage(uint32_t* pixels);
 
-    // internal framebuffer for accumulating multiple images
-    std::vector<glm::vec3> m_accumulationBuffer;
+    void LogPassStatistics(double passSeconds, double passSquaredError, double passErrorPixels);
+
+    void SchedulePass();
+    bool SelectPassTiles(double seconds, bool force);
+    void FinishPass();
+    void ApplyTuning();
+
+    void ResizeFramebuffer();
+    void BuildTiles();
+    void ClearTile(int tileIndex);
+    void ResetActiveTasks();
+    void UpdateNodeOffsets();
+    template <typename Storage>
+    bool IsPixelConverged(const Storage& accumulation, size_t index) const;
+
+    bool IsPassCancelled() const { return m_frameGeneration.load(std::memory_order_relaxed) != m_passGeneration; }
+
+    template <typename T>
+    using AlignedVector = std::vector<T, AlignedAllocator<T, CACHE_LINE_SIZE>>;
 
-    // threadpool for multi-threaded rendering
-    RenderThreadPool m_threadPool;
+    // internal framebuffer for accumulating multiple images, with the number of passes and the sum of squared
+    // luminances per pixel (for estimating the variance of the mean), rows are m_rowStride pixels apart
+    std::unique_ptr<AccumulationBuffer> m_accumulationBuffer;
+    AlignedVector<float> m_luminanceSquaredSums;
+    AlignedVector<uint32_t> m_pixelPasses;
+    int m_rowStride;
+
+    // threadpool for multi-threaded rendering (or the parallel runtime that the build selected)
+    ParallelBackend m_threadPool;
     // trackball and viewport for camera and ray setup
     Trackball m_trackball;
     Viewport m_viewport;
 
-    // number of tasks for rendering
-    int m_numRenderTasks;
+    // lighting setup
+    const LightSampler* m_lightSampler;
+    bool m_nextEventEstimation;
+    float m_backgroundIntensity;
+
+    // path guiding (created on first use, as it needs the scene bounds)
+    bool m_pathGuiding;
+    std::unique_ptr<GuidingField> m_guidingField;
+    int m_guidingPasses;    ///< passes in the current training iteration
+
+    SamplerType m_samplerType;
+
+    // tiles in the order they are issued and the NUMA node of each tile
+    std::vector<Tile> m_tiles;
+    std::vector<int> m_tileNodes;
+    int m_tileSize;
+    TileOrder m_tileOrder;
+    bool m_atomicTileDispatch;
+
+    // adaptive sampling: indices of the tiles that still have unconverged pixels and the convergence state per tile
+    float m_adaptiveThreshold;
+    std::vector<int> m_activeTasks;     ///< grouped by node (see TileBatch)
+    std::vector<int> m_nodeOffsets;
+    std::vector<uint8_t> m_tileConverged;
+    std::vector<uint32_t> m_tilePasses;     ///< passes since the last clear (tiles leave the schedule at the maximum)
+
+    // resolve: version of each tile (changes with its pixels) and the versions last resolved into the most recently used buffers
+    struct ResolvedBuffer
+    {
+        const uint32_t* pixels;
+        std::vector<uint32_t> tileVersions;
+    };
+    std::vector<uint32_t> m_tileVersions;
+    std::vector<ResolvedBuffer> m_resolvedBuffers;
+    std::vector<uint8_t> m_resolveTiles;   ///< changed tiles by position (row by row)
+    PixelFormat m_pixelFormat;
+
+    // foveation: the tiles of the current pass (a subset of the active ones, grouped by node and ordered by priority)
+    bool m_foveation;
+    std::atomic<int> m_focusX;
+    std::atomic<int> m_focusY;
+    std::vector<int> m_passTasks;
+    std::vector<int> m_passOffsets;
+    bool m_passScheduled;
+
+    // statistics: squared deviation of the last pass of a tile from the mean of its previous passes and the number of pixels
+    // it covers, their sums over the tiles that got the current pass, and render time and variance since the last clear
+    bool m_logStatistics;
+    std::vector<double> m_tileSquaredErrors;
+    std::vector<int> m_tileErrorPixels;
+    double m_passSquaredError;
+    double m_passErrorPixels;
+    double m_statisticsSeconds;
+    double m_statisticsVarianceSum;
+    int m_statisticsVariancePasses;
+
+    // frame budget: render time per tile (moving average over the passes), tiles of each node's range of m_passTasks that
+    // are done, and the tiles that are issued next (grouped by node)
+    double m_frameBudget;
+    std::vector<float> m_tileSeconds;
+    std::vector<float> m_tileLastSeconds;   ///< written by the thread that renders the tile
+    std::vector<int> m_passProgress;
+    std::vector<int> m_chunkTasks;
+    std::vector<int> m_chunkOffsets;
+    double m_passSeconds;
+    double m_passBusySeconds;
+    double m_passPixels;
+    double m_resolveSeconds;
+
+    // auto-tuning of the tile size and the number of threads (from the same measurements)
+    bool m_autoTuning;
+    AutoTuner m_autoTuner;
+
     // number of refinement iterations so far
     int m_currentRefinementIteration;
 
-    // static vector containing subpixel offsets for MSAA
-    const static std::vector<glm::vec2> ms_samples;
-    // weighting factor for averaging subpixel samples
-    const static float ms_weightingFactor;
+    // cancellation: CancelFrame() changes the generation, the pass in flight stops when it differs from the one it started with
+    std::atomic<uint32_t> m_frameGeneration;
+    uint32_t m_passGeneration;
 };
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "commonheader.h"
+
+#include "renderer.h"
+#include "triplebuffer.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Keeps refining the image on a background thread, so presenting and input handling never wait for a pass.
+/// Completed frames are handed to the presenting thread through a triple buffer.
+class RenderLoop
+{
+public:
+    RenderLoop(Renderer& renderer, const Hitable& world);
+    ~RenderLoop();
+
+    RenderLoop(const RenderLoop&) = delete;
+    RenderLoop& operator=(const RenderLoop&) = delete;
+
+    /// Cancels the pass in flight and blocks until the render thread is idle, so the renderer may be modified until Resume()
+    void Pause();
+
+    /// Continues refining (from scratch if the framebuffer is cleared, a frame that was completed before is not presented then)
+    void Resume(bool clearFramebuffer);
+
+    /// Suspended: no passes are started (the pass in flight is cancelled) until the loop is unsuspended, e.g. to leave the
+    /// CPUs to other jobs, settings may still change in between (Pause() and Resume() are independent of this)
+    void SetSuspended(bool suspended);
+    bool IsSuspended() const { return m_suspended; }
+
+    /// True if the render thread neither renders nor starts a pass before the next Resume() or SetSuspended(false), and the
+    /// latest frame has been acquired (only called by the presenting thread, which may then block until the next input)
+    bool IsIdle();
+
+    /// Returns the latest completed frame if there is one that has not been returned yet, nullptr otherwise
+    /// (only called by the presenting thread, the pixels stay valid until the next call or Resume())
+    const uint32_t* AcquireFrame();
+
+private:
+    void ThreadLoop();
+
+    /// Whether the render thread has a pass to render (called with the mutex locked)
+    bool HasWork() const;
+
+    Renderer& m_renderer;
+    const Hitable& m_world;
+
+    TripleBuffer<std::vector<uint32_t>> m_frames;
+
+    // the render thread only starts a pass while neither paused nor suspended, m_rendering is set while it is in Render()
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_paused;
+    bool m_suspended;
+    bool m_rendering;
+    bool m_clearFramebuffer;
+    bool m_stopThread;
+
+    std::thread m_thread;
+};
@@ -4,21 +4,25 @@
 
 #include "camera.h"
 #include "hitable.h"
+#include "random.h"
+#include "workstealingdeque.h"
 
+#include <atomic>
+#include <functional>
 #include <thread>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <deque>
 
 class Renderer;
 
-// task for multi-threaded raytracing comprising multiple lines
+// task for multi-threaded raytracing comprising one tile
 struct RenderTask
 {
     Renderer* renderer;
 
-    int minLine;
-    int maxLine; // exclusive - the max line is not rendered
+    int tileIndex;
 
     const Camera& camera;
     const Hitable& world;
@@ -31,10 +35,25 @@ struct RenderTask
     void operator()();
 };
 
+// tiles of one refinement iteration (or other work per tile) for the persistent workers, which take the indices from
+// one atomic counter per NUMA node (no allocation and no lock per tile)
+struct TileBatch
+{
+    // the tiles of node n are tiles[nodeOffsets[n]] ... tiles[nodeOffsets[n + 1] - 1], workers start with the tiles of their node
+    // (tiles == nullptr: the indices are the tiles)
+    const int* tiles;
+    const int* nodeOffsets;
+
+    // called for each tile
+    std::function<void(int tile)> function;
+};
+
 class RenderThreadPool
 {
 public:
-    RenderThreadPool(int numThreads = std::thread::hardware_concurrency());
+    // numThreads includes the thread that submits work, which helps while waiting (so numThreads - 1 workers are started),
+    // topology aware: workers are pinned to CPUs and distributed evenly over the NUMA nodes
+    RenderThreadPool(int numThreads = std::thread::hardware_concurrency(), bool topologyAware = false);
     ~RenderThreadPool();
 
     RenderThreadPool(const RenderThreadPool&) = delete;
@@ -42,31 +61,100 @@ public:
     RenderThreadPool(RenderThreadPool&&) = delete;
     RenderThreadPool& operator=(RenderThreadPool&&) = delete;
 
-    // (synchronized) method for adding a new task to the queue
+    // method for adding a new task (from outside of the pool), tasks go to the injection queue and are then distributed
+    // to the per-thread deques, from which idle threads steal
     void AddTask(RenderTask r);
 
-    // wait until all tasks are finished (i.e. task counter == 0)
+    // wait until all tasks are finished (i.e. task counter == 0), the calling thread runs queued tasks itself until none are
+    // left and then spins shortly before blocking
     void WaitForTasks();
 
-    // functionality for setting task counter to set the number of jobs and control when they are finished (unsynchronized!!!)
-    void SetTaskCounter(int c) { m_taskCounter = c; }
+    // renders all tiles of the batch and returns when they are finished: the batch is published with a new frame epoch,
+    // the workers and the calling thread take tile indices from the shared counters until they run out, and the workers
+    // check in at the barrier (only one thread may submit batches at a time, batches submitted from inside a batch run serially)
+    void RunTileBatch(const TileBatch& batch);
+
+    // fork-join loop on the workers and the calling thread: calls function(i) for all i in [begin, end) and returns when all
+    // calls are finished, indices are handed out in chunks of grainSize (same restrictions as RunTileBatch())
+    void ParallelFor(int begin, int end, const std::function<void(int)>& function, int grainSize = 1);
+
+    // functionality for setting task counter to set the number of jobs and control when they are finished (call before adding the tasks)
+    void SetTaskCounter(int c) { m_taskCounter.store(c, std::memory_order_release); }
 
-    size_t GetNumThreads() const { return m_threads.size(); }
+    // workers and the submitting thread
+    size_t GetNumThreads() const { return m_threads.size() + 1; }
+
+    // limits the threads that take work (including the submitting thread, at least 1), the other workers stay idle
+    // (only called between batches by the submitting thread)
+    void SetNumActiveThreads(int numThreads);
+    size_t GetNumActiveThreads() const { return static_cast<size_t>(m_numActiveWorkers.load(std::memory_order_relaxed)) + 1; }
+
+    // NUMA nodes the workers are distributed over (1 if the pool is not topology aware)
+    int GetNumNodes() const { return m_numNodes; }
+
+    static const char* GetName() { return "thread pool"; }
 
 protected:
-    // task queue
-    std::queue<RenderTask> m_taskQueue;
-    std::mutex m_queueMutex;
-    std::condition_variable m_queueCondition;
+    void WorkerLoop(int threadIndex);
+
+    // own deque first, then stealing from a random other thread, then a batch from the injection queue
+    RenderTask* FindTask(int threadIndex, Pcg32& rng);
+
+    // for the waiting thread, which has no deque: a task from the injection queue, otherwise one stolen from a worker
+    RenderTask* FindTaskForCaller(Pcg32& rng);
+
+    // runs the task and counts it as finished
+    void RunTask(RenderTask* task);
+
+    // takes tiles of the current batch (from the home node first) until none are left
+    void RunTiles(int homeNode);
+
+    // for a worker: runs tiles of the current batch and checks in at the barrier
+    void RenderTileBatch(int threadIndex);
+
+    // wait until the predicate holds, spins shortly before blocking on the task counter condition variable
+    template <typename Predicate>
+    void WaitUntil(Predicate done);
+
+    // per-thread deques (only the owner pushes and pops, everybody steals)
+    std::vector<std::unique_ptr<WorkStealingDeque<RenderTask>>> m_deques;
+
+    // injection queue for tasks added from outside of the pool
+    std::deque<RenderTask*> m_injectionQueue;
+    std::mutex m_injectionMutex;
+    std::atomic<int> m_numInjected;
+
+    // idle threads park on the condition variable, the epoch changes whenever new work arrives (so no wakeup is lost)
+    std::atomic<uint64_t> m_workEpoch;
+    std::atomic<int> m_numParked;
+    std::mutex m_parkMutex;
+    std::condition_variable m_parkCondition;
+
+    // NUMA node and CPU of each worker (CPU -1: not pinned)
+    int m_numNodes;
+    std::vector<int> m_workerNodes;
+    std::vector<int> m_workerCpus;
+
+    // next tile per node, the padding keeps the counters of different nodes on different cache lines
+    struct NodeCounter
+    {
+        std::atomic<int> nextTile;
+        char padding[64 - sizeof(std::atomic<int>)];
+    };
+
+    // current tile batch, only replaced once all workers have checked in at the barrier of the previous one
+    const TileBatch* m_tileBatch;
+    std::atomic<uint64_t> m_frameEpoch;
+    std::unique_ptr<NodeCounter[]> m_nextTiles;
+    std::atomic<int> m_numWorkersInFrame;   ///< workers that have not yet finished the current batch
 
     // counter for checking if all current tasks are done (needs to be set up front and is decreased once for each task that is finished)
-    int m_taskCounter;
+    std::atomic<int> m_taskCounter;
     std::mutex m_taskCounterMutex;
     std::condition_variable m_taskCounterCondition;
 
-    // thread pool
+    // thread pool, workers with an index of at least m_numActiveWorkers do not take tiles or tasks
     std::vector<std::thread> m_threads;
-    bool m_stopThreads;   // for signaling threads to stop working
+    std::atomic<int> m_numActiveWorkers;
+    std::atomic<bool> m_stopThreads;   // for signaling threads to stop working
 };
-
-
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "commonheader.h"
+
+#include "random.h"
+
+#include <memory>
+
+enum class SamplerType
+{
+    Random,     ///< independent PCG32 numbers (white noise)
+    Sobol,      ///< Owen-scrambled Sobol points
+    R2,         ///< R2 sequence with a random rotation per pixel
+    BlueNoise,  ///< R2 sequence rotated by a blue-noise mask, so the remaining error is distributed as blue noise
+    Count
+};
+
+const char* GetSamplerName(SamplerType type);
+
+/// Provides the random numbers of one sample of a pixel, dimension by dimension.
+/// Sample indices continue over refinement iterations, so stratification keeps improving the longer a pixel is refined.
+/// All samplers are padded: each dimension (pair) is a separately scrambled copy of a 1D (2D) point set,
+/// which makes the number of dimensions unlimited and the dimensions of different bounces independent.
+class Sampler
+{
+public:
+    virtual ~Sampler() = default;
+
+    /// Starts the sample with the given index of pixel (x, y) at dimension 0
+    void StartPixelSample(int x, int y, uint32_t sampleIndex)
+    {
+        m_pixelSeed = MixBits((static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32) | static_cast<uint32_t>(x));
+        m_x = x;
+        m_y = y;
+        m_sampleIndex = sampleIndex;
+        m_dimension = 0;
+        OnStartPixelSample();
+    }
+
+    /// Jumps to the given dimension, which allows fixed dimensions per bounce regardless of how many the previous bounce used
+    void SetDimension(uint32_t dimension) { m_dimension = dimension; }
+
+    /// Returns the next dimension in [0, 1)
+    float Get1D() { return Sample1D(m_dimension++); }
+
+    /// Returns the next two dimensions in [0, 1)^2, stratified jointly
+    glm::vec2 Get2D()
+    {
+        glm::vec2 u = Sample2D(m_dimension);
+        m_dimension += 2;
+        return u;
+    }
+
+protected:
+    Sampler() = default;
+
+    virtual void OnStartPixelSample() {}
+    virtual float Sample1D(uint32_t dimension) = 0;
+    virtual glm::vec2 Sample2D(uint32_t dimension) = 0;
+
+    /// Seed for scrambling a dimension of the current pixel
+    uint32_t DimensionSeed(uint32_t dimension) const { return static_cast<uint32_t>(MixBits(m_pixelSeed ^ (static_cast<uint64_t>(dimension) + 1))); }
+
+    uint64_t m_pixelSeed = 0;
+    int m_x = 0;
+    int m_y = 0;
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+/// Creates a sampler, each render thread uses its own
+std::unique_ptr<Sampler> CreateSampler(SamplerType type);
+
+/// Independent (white noise) numbers, hashed from pixel, sample index and dimension.
+/// Eight consecutive dimensions are generated together (see RandomFloats8()).
+class RandomSampler : public Sampler
+{
+protected:
+    virtual void OnStartPixelSample() override;
+    virtual float Sample1D(uint32_t dimension) override;
+    virtual glm::vec2 Sample2D(uint32_t dimension) override;
+
+private:
+    uint32_t m_key = 0;
+    uint32_t m_blockStart = ~0u;    ///< first dimension in m_block (~0 if invalid)
+    float m_block[8];
+};
+
+/// Sobol (0, 2)-sequence with nested uniform (Owen) scrambling and a scrambled sample order per dimension
+/// (see Burley, "Practical Hash-based Owen Scrambling", 2020)
+class SobolSampler : public Sampler
+{
+protected:
+    virtual float Sample1D(uint32_t dimension) override;
+    virtual glm::vec2 Sample2D(uint32_t dimension) override;
+};
+
+/// Additive recurrence based on the plastic number (Roberts, "The Unreasonable Effectiveness of Quasirandom Sequences", 2018)
+/// with a Cranley-Patterson rotation per pixel and dimension
+class R2Sampler : public Sampler
+{
+protected:
+    virtual float Sample1D(uint32_t dimension) override;
+    virtual glm::vec2 Sample2D(uint32_t dimension) override;
+
+    /// Rotation of the sequence for the current pixel in 0.32 fixed point
+    virtual uint32_t Offset(uint32_t dimension) const;
+};
+
+/// R2 sampler whose rotations come from a void-and-cluster blue-noise mask (one toroidal shift of the mask per dimension),
+/// so neighboring pixels get dissimilar rotations and the error of low sample counts looks like fine grain instead of blotches
+class BlueNoiseSampler : public R2Sampler
+{
+protected:
+    virtual uint32_t Offset(uint32_t dimension) const override;
+};
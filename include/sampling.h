@@ -0,0 +1,96 @@
+#pragma once
+
+#include "commonheader.h"
+
+//**************************************************************************//
+// closed-form warps from uniform random numbers in [0, 1) to directions    //
+// (no rejection loops, so the number of random numbers per call is fixed)  //
+//**************************************************************************//
+
+constexpr float SAMPLING_PI = 3.14159265358979323846f;
+constexpr float SAMPLING_INV_PI = 1.f / SAMPLING_PI;
+
+/// Uniformly distributed direction on the unit sphere
+inline glm::vec3 SampleUniformSphere(const glm::vec2& u)
+{
+    float z = 1.f - 2.f * u.x;
+    float r = glm::sqrt(glm::max(0.f, 1.f - z * z));
+    float phi = 2.f * SAMPLING_PI * u.y;
+
+    return glm::vec3(r * glm::cos(phi), r * glm::sin(phi), z);
+}
+
+inline float UniformSpherePdf()
+{
+    return 1.f / (4.f * SAMPLING_PI);
+}
+
+/// Builds an orthonormal basis (b1, b2, n) for a normalized vector n without branching on the dominant axis
+/// (see Duff et al., "Building an Orthonormal Basis, Revisited", 2017)
+inline void BuildOrthonormalBasis(const glm::vec3& n, glm::vec3& b1, glm::vec3& b2)
+{
+    float sign = (n.z >= 0.f) ? 1.f : -1.f;
+    float a = -1.f / (sign + n.z);
+    float b = n.x * n.y * a;
+
+    b1 = glm::vec3(1.f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    b2 = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+}
+
+/// Cosine-weighted direction in the hemisphere around the normalized vector n.
+/// Offsetting a uniform point on the unit sphere by the normal yields exactly the cosine distribution,
+/// so no tangent frame is needed.
+inline glm::vec3 SampleCosineHemisphere(const glm::vec3& n, const glm::vec2& u)
+{
+    glm::vec3 d = n + SampleUniformSphere(u);
+    float lengthSquared = glm::dot(d, d);
+
+    // the sphere sample is (almost) exactly opposite to the normal - happens with probability zero
+    if (lengthSquared < 1e-12f)
+    {
+        return n;
+    }
+
+    return d / glm::sqrt(lengthSquared);
+}
+
+inline float CosineHemispherePdf(float cosTheta)
+{
+    return glm::max(cosTheta, 0.f) * SAMPLING_INV_PI;
+}
+
+/// Uniformly distributed direction within the cone around the normalized vector axis with the given opening angle
+inline glm::vec3 SampleUniformCone(const glm::vec3& axis, float cosThetaMax, const glm::vec2& u)
+{
+    float cosTheta = 1.f - u.x * (1.f - cosThetaMax);
+    float sinTheta = glm::sqrt(glm::max(0.f, 1.f - cosTheta * cosTheta));
+    float phi = 2.f * SAMPLING_PI * u.y;
+
+    glm::vec3 b1, b2;
+    BuildOrthonormalBasis(axis, b1, b2);
+
+    return (sinTheta * glm::cos(phi)) * b1 + (sinTheta * glm::sin(phi)) * b2 + cosTheta * axis;
+}
+
+inline float UniformConePdf(float cosThetaMax)
+{
+    return 1.f / (2.f * SAMPLING_PI * (1.f - cosThetaMax));
+}
+
+/// Power heuristic (beta = 2) for multiple importance sampling of a sample drawn with fPdf against the strategy gPdf
+inline float PowerHeuristic(float fPdf, float gPdf)
+{
+    float f2 = fPdf * fPdf;
+    float g2 = gPdf * gPdf;
+
+    return (f2 > 0.f) ? f2 / (f2 + g2) : 0.f;
+}
+
+/// Schlick's approximation of the Fresnel reflectance for the reflectance r0 at normal incidence (without glm::pow)
+inline float SchlickFresnel(float cosine, float r0)
+{
+    float x = glm::clamp(1.f - cosine, 0.f, 1.f);
+    float x2 = x * x;
+
+    return r0 + (1.f - r0) * (x2 * x2 * x);
+}
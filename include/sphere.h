@@ -19,6 +19,16 @@ public:
 
     virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const override;
 
+    virtual Aabb BoundingBox() const override;
+
+    virtual void ComputeTextureCoordinates(HitRecord& rec) const override;
+
+    /// Samples a direction from point p towards the sphere uniformly in the cone of directions it subtends
+    /// (pdf w.r.t. solid angle, zero if p lies inside of the sphere)
+    glm::vec3 SampleDirection(const glm::vec3& p, const glm::vec2& u, float& pdf) const;
+    /// Solid angle density of SampleDirection() for point p
+    float DirectionPdf(const glm::vec3& p) const;
+
 private:
     glm::vec3 m_center;
     float m_radius;
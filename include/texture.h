@@ -0,0 +1,73 @@
+#pragma once
+
+#include "commonheader.h"
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Texture
+{
+public:
+    virtual ~Texture() = default;
+
+    /// Filtered color for the texture coordinates uv with the screen-space derivatives duvdx and duvdy
+    virtual glm::vec3 Value(const glm::vec2& uv, const glm::vec2& duvdx, const glm::vec2& duvdy) const = 0;
+};
+
+/// Tile of texels of an image texture: 32x32 texels (RGBA8, 4 KB) in Morton order, so that bilinear lookups touch few cache lines
+struct TextureTile
+{
+    static constexpr int SIZE_LOG2 = 5;
+    static constexpr int SIZE = 1 << SIZE_LOG2;
+    static constexpr int NUM_TEXELS = SIZE * SIZE;
+
+    uint32_t texels[NUM_TEXELS];
+};
+
+/// Mip-mapped image texture (repeating, sRGB) that is stored tiled in a backing file and paged in through the TextureCache
+class ImageTexture : public Texture
+{
+public:
+    /// Creates a texture from RGBA8 pixels (row-major, top row first), returns nullptr if the backing store cannot be created
+    static std::unique_ptr<ImageTexture> Create(int width, int height, const std::vector<uint32_t>& pixels, float uvScale = 1.f);
+    /// Loads a texture from a BMP file, returns nullptr on failure
+    static std::unique_ptr<ImageTexture> LoadBMP(const char* filename, float uvScale = 1.f);
+
+    ~ImageTexture();
+
+    ImageTexture(const ImageTexture&) = delete;
+    ImageTexture& operator=(const ImageTexture&) = delete;
+
+    virtual glm::vec3 Value(const glm::vec2& uv, const glm::vec2& duvdx, const glm::vec2& duvdy) const override;
+
+    uint32_t GetId() const { return m_id; }
+    int GetNumLevels() const { return static_cast<int>(m_levels.size()); }
+
+    /// Reads a tile from the backing store (called by the TextureCache on a miss)
+    void LoadTile(int level, int tileIndex, TextureTile& tile) const;
+
+private:
+    struct MipLevel
+    {
+        int width;
+        int height;
+        int tilesX;
+        int tilesY;
+        long fileOffset;    ///< byte offset of the first tile of the level in the backing file
+    };
+
+    ImageTexture(float uvScale);
+
+    glm::vec3 Bilinear(int level, glm::vec2 uv) const;
+    uint32_t FetchTexel(int level, int x, int y) const;
+
+    uint32_t m_id;
+    float m_uvScale;
+    std::vector<MipLevel> m_levels;
+
+    // tiled mip chain on disk, so that texture sets larger than memory can be paged
+    std::FILE* m_backingFile;
+    mutable std::mutex m_fileMutex;
+};
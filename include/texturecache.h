@@ -0,0 +1,56 @@
+#pragma once
+
+#include "texture.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/// Global cache of resident texture tiles with a memory budget and least-recently-used eviction
+class TextureCache
+{
+public:
+    static TextureCache& GetInstance();
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /// Memory budget for resident tiles in bytes (tiles are evicted once it is exceeded)
+    size_t GetMemoryBudget() const { return NUM_SHARDS * m_maxTilesPerShard * sizeof(TextureTile); }
+    void SetMemoryBudget(size_t bytes);
+
+    /// Returns the tile, loading it from the texture's backing store on a miss
+    std::shared_ptr<const TextureTile> GetTile(const ImageTexture& texture, int level, int tileIndex);
+
+    /// Drops all tiles of a texture (when it is destroyed)
+    void EvictTexture(uint32_t textureId);
+
+    // lookup statistics (unsynchronized, for logging only)
+    uint64_t GetNumHits() const;
+    uint64_t GetNumMisses() const;
+
+private:
+    TextureCache();
+
+    struct Entry
+    {
+        std::shared_ptr<const TextureTile> tile;
+        std::list<uint64_t>::iterator lruPosition;
+    };
+
+    // the cache is split into independently locked shards to reduce contention between render threads
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Entry> entries;
+        std::list<uint64_t> lru;    ///< most recently used key at the front
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    static constexpr size_t NUM_SHARDS = 16;
+    Shard m_shards[NUM_SHARDS];
+    size_t m_maxTilesPerShard;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+
+/// Lock-free handoff of frames from one producer to one consumer thread. The producer writes to the back buffer and
+/// publishes it by exchanging it with the middle buffer, the consumer exchanges the middle buffer with its front buffer
+/// if a newer one has been published. Neither thread ever waits for the other, and the consumer always gets the latest frame.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+    : m_back(0)
+    , m_middle(1)
+    , m_front(2)
+    {
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    /// Only called by the producer
+    T& GetBackBuffer() { return m_buffers[m_back]; }
+
+    /// Only called by the producer, makes the back buffer the latest frame
+    void Publish()
+    {
+        int previous = m_middle.exchange(m_back | NEW_FRAME, std::memory_order_acq_rel);
+        m_back = previous & INDEX_MASK;
+    }
+
+    /// Only called by the consumer, returns true if the front buffer now holds a newer frame
+    bool Update()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & NEW_FRAME) == 0)
+        {
+            return false;
+        }
+
+        int previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX_MASK;
+        return true;
+    }
+
+    /// Only called by the consumer, true if Update() would return a newer frame
+    bool HasNewFrame() const { return (m_middle.load(std::memory_order_relaxed) & NEW_FRAME) != 0; }
+
+    /// Only called by the consumer
+    const T& GetFrontBuffer() const { return m_buffers[m_front]; }
+
+    /// Only while no other thread accesses the buffers (e.g. for allocating them)
+    T& GetBuffer(int i) { return m_buffers[i]; }
+
+private:
+    static constexpr int INDEX_MASK = 3;
+    static constexpr int NEW_FRAME = 4;     ///< set in m_middle if the producer published it after the consumer's last update
+
+    T m_buffers[3];
+
+    int m_back;                 ///< only accessed by the producer
+    std::atomic<int> m_middle;  ///< index and flag
+    int m_front;                ///< only accessed by the consumer
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/// Chase-Lev work-stealing deque of pointers ("Dynamic Circular Work-Stealing Deque", Chase and Lev, 2005;
+/// memory orders from "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al., 2013).
+/// The owning thread pushes and pops at the bottom without locks, other threads steal from the top.
+template <typename T>
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+    : m_top(0)
+    , m_bottom(0)
+    , m_array(new Array(capacity))
+    {
+    }
+
+    ~WorkStealingDeque()
+    {
+        delete m_array.load(std::memory_order_relaxed);
+        for (Array* a : m_retiredArrays)
+        {
+            delete a;
+        }
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /// Only called by the owner
+    void Push(T* item)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+
+        if (b - t > a->capacity - 1)
+        {
+            a = Grow(a, t, b);
+        }
+
+        a->Put(b, item);
+        m_bottom.store(b + 1, std::memory_order_release);
+    }
+
+    /// Only called by the owner, returns nullptr if the deque is empty
+    T* Pop()
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // empty
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* item = a->Get(b);
+        if (t == b)
+        {
+            // last item: race against thieves
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /// Called by any thread, returns nullptr if the deque is empty or another thread took the item first
+    T* Steal()
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+        {
+            return nullptr;
+        }
+
+        Array* a = m_array.load(std::memory_order_acquire);
+        T* item = a->Get(t);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+    /// Approximate number of items (exact only if no other thread accesses the deque)
+    int64_t GetSize() const
+    {
+        return m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(int64_t c) : capacity(c), items(new std::atomic<T*>[c]) {}
+        ~Array() { delete[] items; }
+
+        T* Get(int64_t i) const { return items[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void Put(int64_t i, T* item) { items[i & (capacity - 1)].store(item, std::memory_order_relaxed); }
+
+        int64_t capacity;   ///< power of two
+        std::atomic<T*>* items;
+    };
+
+    Array* Grow(Array* a, int64_t t, int64_t b)
+    {
+        Array* grown = new Array(2 * a->capacity);
+        for (int64_t i = t; i < b; ++i)
+        {
+            grown->Put(i, a->Get(i));
+        }
+
+        // thieves may still read from the old array, so it is only deleted with the deque
+        m_retiredArrays.push_back(a);
+        m_array.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+    // top and bottom are on separate cache lines, thieves only write the top
+    std::atomic<int64_t> m_top;
+    char m_padding[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> m_bottom;
+    std::atomic<Array*> m_array;
+    std::vector<Array*> m_retiredArrays;    ///< only accessed by the owner
+};
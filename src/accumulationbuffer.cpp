@@ -0,0 +1,277 @@
+#include "accumulationbuffer.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// pixels whose means are converted at once by the resolve of formats that are not resolved directly
+constexpr int RESOLVE_CHUNK_PIXELS = 64;
+
+namespace
+{
+    uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    /// The buffer accumulates linear radiance, gamma is applied to the mean (applying it per pass would bias the result
+    /// by an amount depending on the per-pass variance, i.e. on the sampler)
+    inline uint32_t ResolvePixel(const glm::vec3& sum, uint32_t passes, int redShift, int blueShift)
+    {
+        glm::vec3 color = glm::min(sum * (passes > 0 ? 1.f / static_cast<float>(passes) : 0.f), glm::vec3(1.f));
+        color = glm::sqrt(color);
+
+        uint8_t rc = static_cast<uint8_t>(color.r * 255.f);
+        uint8_t gc = static_cast<uint8_t>(color.g * 255.f);
+        uint8_t bc = static_cast<uint8_t>(color.b * 255.f);
+
+        uint32_t pixel = 0xFF << 24;  // full alpha
+        pixel |= (static_cast<uint32_t>(rc) << redShift);
+        pixel |= (static_cast<uint32_t>(gc) << 8);
+        pixel |= (static_cast<uint32_t>(bc) << blueShift);
+        return pixel;
+    }
+
+#if defined(__AVX2__)
+    /// Converts the interleaved RGB means of 8 pixels (24 floats in 3 vectors) to 8 pixels
+    class InterleavedPacker
+    {
+    public:
+        explicit InterleavedPacker(PixelFormat format)
+        : m_packedOrder(_mm256_setr_epi32(0, 4, 1, 5, 5, 2, 6, 7))
+        , m_rgbToPixels((format == PixelFormat::BGRA)
+            ? _mm256_setr_epi8(
+                2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128,
+                2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128)
+            : _mm256_setr_epi8(
+                0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128,
+                0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128))
+        {
+        }
+
+        __m256i Pack(const __m256 means[3]) const
+        {
+            const __m256 one = _mm256_set1_ps(1.f);
+            __m256i v[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                __m256 x = _mm256_sqrt_ps(_mm256_min_ps(one, means[k]));
+                v[k] = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(255.f)));
+            }
+
+            // saturating packs (32 -> 16 -> 8 bits), then the dwords of the 24 RGB bytes are moved so that each 128-bit lane
+            // holds 4 pixels (lane 1 starts at byte 12), which are expanded to RGBA or BGRA
+            __m256i bytes = _mm256_packus_epi16(_mm256_packus_epi32(v[0], v[1]), _mm256_packus_epi32(v[2], v[2]));
+            bytes = _mm256_permutevar8x32_epi32(bytes, m_packedOrder);
+            return _mm256_or_si256(_mm256_shuffle_epi8(bytes, m_rgbToPixels), _mm256_set1_epi32(static_cast<int>(0xFF000000u)));
+        }
+
+    private:
+        __m256i m_packedOrder;
+        __m256i m_rgbToPixels;
+    };
+#endif
+
+    /// Resolves sums of colors stored as glm::vec3 (RGB interleaved).
+    /// Uses AVX2 for 8 pixels at a time when compiled with AVX2 (the scalar loop gives identical results).
+    void ResolvePixels(const glm::vec3* colors, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format)
+    {
+        int i = 0;
+#if defined(__AVX2__)
+        // the per-pixel scale is spread over the components
+        const __m256i spread[3] = {
+            _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2),
+            _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5),
+            _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7) };
+        const InterleavedPacker packer(format);
+        const __m256 one = _mm256_set1_ps(1.f);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 n = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(passes + i)));
+            __m256 scale = _mm256_and_ps(_mm256_div_ps(one, n), _mm256_cmp_ps(n, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+            const float* c = &colors[i].x;
+            __m256 means[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                means[k] = _mm256_mul_ps(_mm256_loadu_ps(c + 8 * k), _mm256_permutevar8x32_ps(scale, spread[k]));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), packer.Pack(means));
+        }
+#endif
+        const int redShift = (format == PixelFormat::BGRA) ? 16 : 0;
+        const int blueShift = 16 - redShift;
+        for (; i < count; ++i)
+        {
+            pixels[i] = ResolvePixel(colors[i], passes[i], redShift, blueShift);
+        }
+    }
+
+    /// Formats that store means or need more than float precision: the means are converted in chunks and resolved as
+    /// the sums of a single pass
+    template <typename Storage>
+    void ResolveMeans(const Storage& storage, size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format)
+    {
+        glm::vec3 means[RESOLVE_CHUNK_PIXELS];
+        uint32_t ones[RESOLVE_CHUNK_PIXELS];
+        std::fill(ones, ones + RESOLVE_CHUNK_PIXELS, 1u);
+
+        for (int first = 0; first < count; first += RESOLVE_CHUNK_PIXELS)
+        {
+            int n = std::min(count - first, RESOLVE_CHUNK_PIXELS);
+            for (int i = 0; i < n; ++i)
+            {
+                means[i] = storage.GetMean(index + first + i, passes[first + i]);
+            }
+            ResolvePixels(means, ones, pixels + first, n, format);
+        }
+    }
+}
+
+void FloatSums::Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const
+{
+    ResolvePixels(&sums[index], passes, pixels, count, format);
+}
+
+uint64_t FloatSums::Hash(uint64_t hash) const
+{
+    return HashBytes(hash, sums.data(), sums.size() * sizeof(glm::vec3));
+}
+
+/// With F16C, the 24 half floats of 8 pixels are converted at once and packed like float means (identical to the scalar conversion)
+void HalfMeans::Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const
+{
+    int i = 0;
+#if defined(__AVX2__) && defined(__F16C__)
+    const InterleavedPacker packer(format);
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i* halves = reinterpret_cast<const __m128i*>(&means[index + i]);
+        __m256 converted[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            converted[k] = _mm256_cvtph_ps(_mm_loadu_si128(halves + k));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), packer.Pack(converted));
+    }
+#endif
+    ResolveMeans(*this, index + i, passes + i, pixels + i, count - i, format);
+}
+
+uint64_t HalfMeans::Hash(uint64_t hash) const
+{
+    return HashBytes(hash, means.data(), means.size() * sizeof(Pixel));
+}
+
+void DoubleSums::Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const
+{
+    ResolveMeans(*this, index, passes, pixels, count, format);
+}
+
+uint64_t DoubleSums::Hash(uint64_t hash) const
+{
+    return HashBytes(hash, sums.data(), sums.size() * sizeof(glm::dvec3));
+}
+
+void KahanSums::Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const
+{
+    ResolveMeans(*this, index, passes, pixels, count, format);
+}
+
+uint64_t KahanSums::Hash(uint64_t hash) const
+{
+    return HashBytes(hash, sums.data(), sums.size() * sizeof(Pixel));
+}
+
+/// Each channel is a plain vector of 8 pixels, so no shuffles are needed (the scalar loop gives identical results)
+void PlanarSums::Resolve(size_t index, const uint32_t* passes, uint32_t* pixels, int count, PixelFormat format) const
+{
+    const float* channels[3] = { &planes[0][index], &planes[1][index], &planes[2][index] };
+
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 maxValue = _mm256_set1_ps(255.f);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 n = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(passes + i)));
+        __m256 scale = _mm256_and_ps(_mm256_div_ps(one, n), _mm256_cmp_ps(n, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+        __m256i v[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            __m256 x = _mm256_mul_ps(_mm256_loadu_ps(channels[k] + i), scale);
+            x = _mm256_sqrt_ps(_mm256_min_ps(one, x));
+            v[k] = _mm256_cvttps_epi32(_mm256_mul_ps(x, maxValue));
+        }
+
+        // the channels are in [0, 255], so they are simply shifted into place
+        __m256i low = (format == PixelFormat::BGRA) ? v[2] : v[0];
+        __m256i high = (format == PixelFormat::BGRA) ? v[0] : v[2];
+        __m256i pixel = _mm256_or_si256(_mm256_or_si256(low, _mm256_slli_epi32(v[1], 8)), _mm256_or_si256(_mm256_slli_epi32(high, 16), alpha));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), pixel);
+    }
+#endif
+    const int redShift = (format == PixelFormat::BGRA) ? 16 : 0;
+    const int blueShift = 16 - redShift;
+    for (; i < count; ++i)
+    {
+        pixels[i] = ResolvePixel(glm::vec3(channels[0][i], channels[1][i], channels[2][i]), passes[i], redShift, blueShift);
+    }
+}
+
+uint64_t PlanarSums::Hash(uint64_t hash) const
+{
+    for (const auto& plane : planes)
+    {
+        hash = HashBytes(hash, plane.data(), plane.size() * sizeof(float));
+    }
+    return hash;
+}
+
+const char* GetAccumulationFormatName(AccumulationFormat format)
+{
+    switch (format)
+    {
+    case AccumulationFormat::Float:
+        return "float";
+    case AccumulationFormat::Half:
+        return "half";
+    case AccumulationFormat::Double:
+        return "double";
+    case AccumulationFormat::Kahan:
+        return "kahan";
+    case AccumulationFormat::Planar:
+        return "planar";
+    default:
+        return "unknown";
+    }
+}
+
+std::unique_ptr<AccumulationBuffer> CreateAccumulationBuffer(AccumulationFormat format)
+{
+    switch (format)
+    {
+    case AccumulationFormat::Half:
+        return std::unique_ptr<AccumulationBuffer>(new TypedAccumulationBuffer<HalfMeans>());
+    case AccumulationFormat::Double:
+        return std::unique_ptr<AccumulationBuffer>(new TypedAccumulationBuffer<DoubleSums>());
+    case AccumulationFormat::Kahan:
+        return std::unique_ptr<AccumulationBuffer>(new TypedAccumulationBuffer<KahanSums>());
+    case AccumulationFormat::Planar:
+        return std::unique_ptr<AccumulationBuffer>(new TypedAccumulationBuffer<PlanarSums>());
+    case AccumulationFormat::Float:
+    default:
+        return std::unique_ptr<AccumulationBuffer>(new TypedAccumulationBuffer<FloatSums>());
+    }
+}
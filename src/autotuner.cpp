@@ -0,0 +1,101 @@
+#include "autotuner.h"
+
+#include "commonheader.h"
+
+#include <algorithm>
+
+// candidate tile sizes (multiples of 16, so that tiles start on cache lines)
+constexpr int TILE_SIZES[] = { 16, 32, 64 };
+constexpr int NUM_TILE_SIZES = sizeof(TILE_SIZES) / sizeof(TILE_SIZES[0]);
+
+// passes per candidate, the first ones are not measured (tiles are rebuilt, threads and caches warm up)
+constexpr int WARMUP_PASSES = 1;
+constexpr int MEASURED_PASSES = 3;
+
+// fewer threads are kept unless the additional ones are faster by at least this factor
+constexpr double MIN_THREAD_SPEEDUP = 1.05;
+
+AutoTuner::AutoTuner(int maxThreads)
+{
+    Reset(maxThreads);
+}
+
+void AutoTuner::Reset(int maxThreads)
+{
+    m_maxThreads = std::max(maxThreads, 1);
+    m_config = Config{ TILE_SIZES[0], m_maxThreads };
+    m_current = Candidate{ m_config, 0.0, 0.0, 0.0 };
+    m_best = m_current;
+    m_numPasses = 0;
+    m_tileSizeIndex = 0;
+    m_done = false;
+}
+
+bool AutoTuner::AddPass(double seconds, double busySeconds, double numPixels)
+{
+    if (m_done || ++m_numPasses <= WARMUP_PASSES)
+    {
+        return false;
+    }
+
+    m_current.seconds += seconds;
+    m_current.busySeconds += busySeconds;
+    m_current.numPixels += numPixels;
+    if (m_numPasses < WARMUP_PASSES + MEASURED_PASSES || m_current.seconds <= 0.0)
+    {
+        return false;
+    }
+
+    FinishCandidate();
+    return true;
+}
+
+void AutoTuner::FinishCandidate()
+{
+    SDL_Log("auto-tuning: %3d px tiles, %2d threads: %7.3f Mpixels/s, %4.1f%% idle",
+        m_current.config.tileSize, m_current.config.numThreads, 1e-6 * m_current.GetThroughput(), 100.0 * m_current.GetIdleFraction());
+
+    if (m_tileSizeIndex < NUM_TILE_SIZES)
+    {
+        // tile sizes: small tiles balance the load better, large ones have less overhead per pixel
+        if (m_tileSizeIndex == 0 || m_current.GetThroughput() > m_best.GetThroughput())
+        {
+            m_best = m_current;
+        }
+        ++m_tileSizeIndex;
+    }
+    else if (m_current.GetThroughput() * MIN_THREAD_SPEEDUP >= m_best.GetThroughput())
+    {
+        // the threads that were removed did not help
+        m_best = m_current;
+    }
+    else
+    {
+        m_done = true;
+    }
+
+    if (!m_done)
+    {
+        if (m_tileSizeIndex < NUM_TILE_SIZES)
+        {
+            m_config = Config{ TILE_SIZES[m_tileSizeIndex], m_maxThreads };
+        }
+        else if (m_best.config.numThreads > 1)
+        {
+            m_config = Config{ m_best.config.tileSize, m_best.config.numThreads / 2 };
+        }
+        else
+        {
+            m_done = true;
+        }
+    }
+
+    if (m_done)
+    {
+        m_config = m_best.config;
+        SDL_Log("auto-tuning: using %d px tiles and %d of %d threads", m_config.tileSize, m_config.numThreads, m_maxThreads);
+    }
+
+    m_current = Candidate{ m_config, 0.0, 0.0, 0.0 };
+    m_numPasses = 0;
+}
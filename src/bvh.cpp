@@ -0,0 +1,112 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+constexpr int MAX_PRIMITIVES_PER_LEAF = 2;
+constexpr int MAX_TRAVERSAL_DEPTH = 64;
+
+Bvh::Bvh(const std::vector<Hitable*>& hitables)
+: m_primitives(hitables)
+{
+    if (!m_primitives.empty())
+    {
+        m_nodes.reserve(2 * m_primitives.size());
+        BuildRecursive(0, static_cast<int>(m_primitives.size()));
+    }
+}
+
+int Bvh::BuildRecursive(int begin, int end)
+{
+    int nodeIndex = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(Node{ Aabb(), begin, end - begin, 0 });
+
+    Aabb box;
+    Aabb centroidBox;
+    for (int i = begin; i < end; ++i)
+    {
+        Aabb primitiveBox = m_primitives[i]->BoundingBox();
+        box.Union(primitiveBox);
+        centroidBox.Union(primitiveBox.Center());
+    }
+    m_nodes[nodeIndex].box = box;
+
+    if (end - begin <= MAX_PRIMITIVES_PER_LEAF)
+    {
+        return nodeIndex;
+    }
+
+    // median split along the axis with the largest centroid extent keeps the tree balanced
+    int axis = centroidBox.MaxExtentAxis();
+    int mid = (begin + end) / 2;
+    std::nth_element(m_primitives.begin() + begin, m_primitives.begin() + mid, m_primitives.begin() + end,
+        [axis](const Hitable* a, const Hitable* b) { return a->BoundingBox().Center()[axis] < b->BoundingBox().Center()[axis]; });
+
+    BuildRecursive(begin, mid);
+    int secondChild = BuildRecursive(mid, end);
+
+    m_nodes[nodeIndex].offset = secondChild;
+    m_nodes[nodeIndex].count = 0;
+    m_nodes[nodeIndex].axis = axis;
+
+    return nodeIndex;
+}
+
+bool Bvh::Hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const
+{
+    if (m_nodes.empty())
+    {
+        return false;
+    }
+
+    glm::vec3 invDirection = 1.f / r.Direction();
+    bool hitAnything = false;
+    float closestSoFar = tMax;
+
+    int stack[MAX_TRAVERSAL_DEPTH];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+
+        if (!node.box.Hit(r, invDirection, tMin, closestSoFar))
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (int i = node.offset; i < node.offset + node.count; ++i)
+            {
+                if (m_primitives[i]->Hit(r, tMin, closestSoFar, rec))
+                {
+                    hitAnything = true;
+                    closestSoFar = rec.t;
+                }
+            }
+        }
+        else
+        {
+            // visit the child closer to the ray origin first (it is pushed last)
+            int firstChild = static_cast<int>(&node - m_nodes.data()) + 1;
+            if (r.Direction()[node.axis] < 0.f)
+            {
+                stack[stackSize++] = firstChild;
+                stack[stackSize++] = node.offset;
+            }
+            else
+            {
+                stack[stackSize++] = node.offset;
+                stack[stackSize++] = firstChild;
+            }
+        }
+    }
+
+    return hitAnything;
+}
+
+Aabb Bvh::BoundingBox() const
+{
+    return m_nodes.empty() ? Aabb() : m_nodes[0].box;
+}
@@ -0,0 +1,120 @@
+#include "cputopology.h"
+
+#include <cstdio>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+    /// Parses a CPU list like "0-3,8-11" (the format of /sys/devices/system/node/node*/cpulist)
+    std::vector<int> ReadCpuList(const char* path)
+    {
+        std::vector<int> cpus;
+        FILE* file = std::fopen(path, "r");
+        if (file == nullptr)
+        {
+            return cpus;
+        }
+
+        int first = 0;
+        while (std::fscanf(file, "%d", &first) == 1)
+        {
+            int last = first;
+            int c = std::fgetc(file);
+            if (c == '-')
+            {
+                if (std::fscanf(file, "%d", &last) != 1)
+                {
+                    break;
+                }
+                c = std::fgetc(file);
+            }
+
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+
+            if (c != ',')
+            {
+                break;
+            }
+        }
+
+        std::fclose(file);
+        return cpus;
+    }
+#endif
+}
+
+CpuTopology CpuTopology::Detect()
+{
+    CpuTopology topology;
+
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveAffinity = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+    // node numbers may have gaps, stop after a few missing ones
+    for (int node = 0, missing = 0; missing < 8; ++node)
+    {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        std::vector<int> cpus = ReadCpuList(path);
+        if (cpus.empty())
+        {
+            ++missing;
+            continue;
+        }
+        missing = 0;
+
+        std::vector<int> usable;
+        for (int cpu : cpus)
+        {
+            if (!haveAffinity || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+            {
+                usable.push_back(cpu);
+            }
+        }
+        if (!usable.empty())
+        {
+            topology.m_nodeCpus.push_back(usable);
+        }
+    }
+#endif
+
+    if (topology.m_nodeCpus.empty())
+    {
+        int numCpus = static_cast<int>(std::thread::hardware_concurrency());
+        topology.m_nodeCpus.push_back(std::vector<int>());
+        for (int cpu = 0; cpu < (numCpus > 0 ? numCpus : 1); ++cpu)
+        {
+            topology.m_nodeCpus[0].push_back(cpu);
+        }
+    }
+
+    return topology;
+}
+
+bool PinCurrentThread(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return (sched_setaffinity(0, sizeof(set), &set) == 0);
+#else
+    (void)cpu;
+    return false;
+#endif
+}
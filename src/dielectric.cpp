@@ -1,10 +1,12 @@
 #include "dielectric.h"
 
-#include "random.h"
+#include "sampling.h"
 
 Dielectric::Dielectric(float ri)
 : m_refractiveIndex(ri)
 {
+    m_r0 = (1.f - m_refractiveIndex) / (1.f + m_refractiveIndex);
+    m_r0 = m_r0 * m_r0;
 }
 
 bool Dielectric::Refract(const glm::vec3& v, const glm::vec3& n, float niOverNt, glm::vec3& refracted) const
@@ -20,14 +22,12 @@ bool Dielectric::Refract(const glm::vec3& v, const glm::vec3& n, float niOverNt,
     }
 }
 
-float Dielectric::Schlick(float cosine, float refractiveIndex) const
+float Dielectric::Schlick(float cosine) const
 {
-    float r0 = (1.f - refractiveIndex) / (1 + refractiveIndex);
-    r0 = r0 * r0;
-    return r0 + (1.f - r0) * glm::pow((1.f - cosine), 5.f);
+    return SchlickFresnel(cosine, m_r0);
 }
 
-bool Dielectric::Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& attenuation, Ray& scattered) const
+bool Dielectric::Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const
 {
     glm::vec3 outwardNormal(0.f);
     glm::vec3 reflected = glm::reflect(inRay.Direction(), rec.normal);
@@ -52,14 +52,14 @@ bool Dielectric::Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& atte
 
     if (Refract(glm::normalize(inRay.Direction()), glm::normalize(outwardNormal), niOverNt, refracted))
     {
-        reflectProb = Schlick(cosine, m_refractiveIndex);
+        reflectProb = Schlick(cosine);
     }
     else
     {
         reflectProb = 1.f;
     }
 
-    if (GetNextRandom() <= reflectProb)
+    if (sampler.Get1D() <= reflectProb)
     {
         scattered = Ray(rec.p, glm::normalize(reflected));
     }
@@ -0,0 +1,11 @@
+#include "diffuselight.h"
+
+DiffuseLight::DiffuseLight(const glm::vec3& emission)
+: m_emission(emission)
+{
+}
+
+bool DiffuseLight::Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const
+{
+    return false;
+}
@@ -0,0 +1,50 @@
+#include "hitable.h"
+
+void HitRecord::ComputeDifferentials(const Ray& r, bool textured)
+{
+    dpdx = glm::vec3(0.f);
+    dpdy = glm::vec3(0.f);
+    duvdx = glm::vec2(0.f);
+    duvdy = glm::vec2(0.f);
+
+    if (!r.HasDifferentials())
+    {
+        return;
+    }
+
+    // intersect the offset rays with the tangent plane at the hit point
+    float d = glm::dot(normal, p);
+    float denominatorX = glm::dot(normal, r.RxDirection());
+    float denominatorY = glm::dot(normal, r.RyDirection());
+    if (denominatorX == 0.f || denominatorY == 0.f)
+    {
+        return;
+    }
+
+    float tx = (d - glm::dot(normal, r.RxOrigin())) / denominatorX;
+    float ty = (d - glm::dot(normal, r.RyOrigin())) / denominatorY;
+    dpdx = r.RxOrigin() + tx * r.RxDirection() - p;
+    dpdy = r.RyOrigin() + ty * r.RyDirection() - p;
+
+    if (!textured)
+    {
+        return;
+    }
+
+    // least squares solution of dpdx = dudx * dpdu + dvdx * dpdv (and the same for y)
+    float a00 = glm::dot(dpdu, dpdu);
+    float a01 = glm::dot(dpdu, dpdv);
+    float a11 = glm::dot(dpdv, dpdv);
+    float determinant = a00 * a11 - a01 * a01;
+    if (glm::abs(determinant) < 1e-12f)
+    {
+        return;
+    }
+
+    float invDeterminant = 1.f / determinant;
+    glm::vec2 bx(glm::dot(dpdu, dpdx), glm::dot(dpdv, dpdx));
+    glm::vec2 by(glm::dot(dpdu, dpdy), glm::dot(dpdv, dpdy));
+
+    duvdx = invDeterminant * glm::vec2(a11 * bx.x - a01 * bx.y, a00 * bx.y - a01 * bx.x);
+    duvdy = invDeterminant * glm::vec2(a11 * by.x - a01 * by.y, a00 * by.y - a01 * by.x);
+}
@@ -29,3 +29,14 @@ bool HitableList::Hit(const Ray& r, float tMin, float tMax, HitRecord& rec) cons
 
     return hitAnything;
 }
+
+Aabb HitableList::BoundingBox() const
+{
+    Aabb box;
+    for (auto& hitable : m_list)
+    {
+        box.Union(hitable->BoundingBox());
+    }
+
+    return box;
+}
@@ -1,16 +1,39 @@
 #include "lambertian.h"
 
+#include "sampling.h"
+
 Lambertian::Lambertian(const glm::vec3& a)
 : m_albedo(a)
+, m_albedoTexture(nullptr)
+{
+}
+
+Lambertian::Lambertian(const Texture* albedoTexture)
+: m_albedo(1.f)
+, m_albedoTexture(albedoTexture)
+{
+}
+
+glm::vec3 Lambertian::Albedo(const HitRecord& rec) const
 {
+    return (m_albedoTexture != nullptr) ? m_albedoTexture->Value(rec.uv, rec.duvdx, rec.duvdy) : m_albedo;
 }
 
-bool Lambertian::Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& attenuation, Ray& scattered) const
+bool Lambertian::Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const
 {
     // compute random direction due to diffuse reflection
-    glm::vec3 target = rec.p + rec.normal + RandomInUnitSphere();
-    scattered = Ray(rec.p, glm::normalize(target - rec.p));
-    attenuation = m_albedo;
+    scattered = Ray(rec.p, SampleCosineHemisphere(rec.normal, sampler.Get2D()));
+    attenuation = Albedo(rec);
 
     return true;
 }
+
+glm::vec3 Lambertian::Evaluate(const Ray& inRay, const HitRecord& rec, const glm::vec3& wi) const
+{
+    return Albedo(rec) * CosineHemispherePdf(glm::dot(rec.normal, wi));
+}
+
+float Lambertian::Pdf(const Ray& inRay, const HitRecord& rec, const glm::vec3& wi) const
+{
+    return CosineHemispherePdf(glm::dot(rec.normal, wi));
+}
@@ -0,0 +1,241 @@
+#include "lightbvh.h"
+
+#include "diffuselight.h"
+#include "sampling.h"
+#include "sphere.h"
+
+#include <algorithm>
+
+namespace
+{
+    float SafeAcos(float x)
+    {
+        return glm::acos(glm::clamp(x, -1.f, 1.f));
+    }
+
+    float Luminance(const glm::vec3& c)
+    {
+        return glm::dot(c, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    /// Smallest cone containing the two cones (a, thetaA) and (b, thetaB), see Conty Estevez and Kulla, "Importance Sampling of Many Lights with Adaptive Tree Splitting", 2018
+    void UnionCones(glm::vec3 a, float thetaA, glm::vec3 b, float thetaB, glm::vec3& axis, float& theta)
+    {
+        if (thetaB > thetaA)
+        {
+            std::swap(a, b);
+            std::swap(thetaA, thetaB);
+        }
+
+        float thetaD = SafeAcos(glm::dot(a, b));
+        if (glm::min(thetaD + thetaB, SAMPLING_PI) <= thetaA)
+        {
+            axis = a;
+            theta = thetaA;
+            return;
+        }
+
+        float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+        glm::vec3 rotationAxis = glm::cross(a, b);
+        if (thetaO >= SAMPLING_PI || glm::dot(rotationAxis, rotationAxis) < 1e-12f)
+        {
+            axis = a;
+            theta = SAMPLING_PI;
+            return;
+        }
+
+        // rotate a towards b by the angle thetaO - thetaA (Rodrigues' formula, a is orthogonal to the rotation axis)
+        float thetaR = thetaO - thetaA;
+        rotationAxis = glm::normalize(rotationAxis);
+        axis = glm::normalize(glm::cos(thetaR) * a + glm::sin(thetaR) * glm::cross(rotationAxis, a));
+        theta = thetaO;
+    }
+}
+
+LightBvh::LightBvh(const std::vector<const Sphere*>& lights)
+: m_lights(lights)
+{
+    m_leafOfLight.resize(m_lights.size(), -1);
+
+    std::vector<int> lightIndices(m_lights.size());
+    for (size_t i = 0; i < m_lights.size(); ++i)
+    {
+        lightIndices[i] = static_cast<int>(i);
+        m_lightIndices[m_lights[i]] = static_cast<int>(i);
+    }
+
+    if (!m_lights.empty())
+    {
+        m_nodes.reserve(2 * m_lights.size());
+        BuildRecursive(lightIndices, 0, static_cast<int>(lightIndices.size()), -1);
+    }
+}
+
+int LightBvh::BuildRecursive(std::vector<int>& lightIndices, int begin, int end, int parent)
+{
+    int nodeIndex = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(Node());
+    m_nodes[nodeIndex].parent = parent;
+
+    if (end - begin == 1)
+    {
+        // spheres emit into all directions from every point of their surface
+        const Sphere* light = m_lights[lightIndices[begin]];
+        const DiffuseLight* material = dynamic_cast<const DiffuseLight*>(light->GetMaterial());
+        float area = 4.f * SAMPLING_PI * light->GetRadius() * light->GetRadius();
+
+        Node& node = m_nodes[nodeIndex];
+        node.bounds = light->BoundingBox();
+        node.axis = glm::vec3(0.f, 0.f, 1.f);
+        node.thetaO = SAMPLING_PI;
+        node.thetaE = 0.5f * SAMPLING_PI;
+        node.power = (material != nullptr) ? SAMPLING_PI * area * Luminance(material->GetEmission()) : 0.f;
+        node.secondChild = -1;
+        node.lightIndex = lightIndices[begin];
+
+        m_leafOfLight[node.lightIndex] = nodeIndex;
+        return nodeIndex;
+    }
+
+    // median split of the light centers along the axis with the largest extent
+    Aabb centroidBox;
+    for (int i = begin; i < end; ++i)
+    {
+        centroidBox.Union(m_lights[lightIndices[i]]->GetCenter());
+    }
+
+    int axis = centroidBox.MaxExtentAxis();
+    int mid = (begin + end) / 2;
+    std::nth_element(lightIndices.begin() + begin, lightIndices.begin() + mid, lightIndices.begin() + end,
+        [this, axis](int a, int b) { return m_lights[a]->GetCenter()[axis] < m_lights[b]->GetCenter()[axis]; });
+
+    int firstChild = BuildRecursive(lightIndices, begin, mid, nodeIndex);
+    int secondChild = BuildRecursive(lightIndices, mid, end, nodeIndex);
+
+    const Node& a = m_nodes[firstChild];
+    const Node& b = m_nodes[secondChild];
+    Node& node = m_nodes[nodeIndex];
+
+    node.bounds = a.bounds;
+    node.bounds.Union(b.bounds);
+    UnionCones(a.axis, a.thetaO, b.axis, b.thetaO, node.axis, node.thetaO);
+    node.thetaE = glm::max(a.thetaE, b.thetaE);
+    node.power = a.power + b.power;
+    node.secondChild = secondChild;
+    node.lightIndex = -1;
+
+    return nodeIndex;
+}
+
+float LightBvh::Importance(const glm::vec3& p, const glm::vec3& n, const Node& node) const
+{
+    glm::vec3 center = node.bounds.Center();
+    float radius = 0.5f * glm::length(node.bounds.Extent());
+
+    // clamp the distance to avoid overestimation when the point lies close to or inside of the bounds
+    glm::vec3 toPoint = p - center;
+    float distanceSquared = glm::max(glm::dot(toPoint, toPoint), radius * radius);
+    float distance = glm::sqrt(glm::dot(toPoint, toPoint));
+    glm::vec3 wi = (distance > 0.f) ? toPoint / distance : glm::vec3(0.f, 0.f, 1.f);
+
+    // angle subtended by the bounding sphere of the node
+    float thetaU = SAMPLING_PI;
+    if (distance > radius)
+    {
+        thetaU = glm::asin(radius / distance);
+    }
+
+    // angle between the shading point and the closest direction of emission
+    float thetaW = SafeAcos(glm::dot(node.axis, wi));
+    float thetaP = glm::max(0.f, thetaW - node.thetaO - thetaU);
+    if (thetaP >= node.thetaE)
+    {
+        return 0.f;
+    }
+
+    // lights below the horizon of the shading point cannot contribute
+    float thetaI = SafeAcos(glm::dot(n, -wi));
+    float cosThetaI = glm::cos(glm::max(0.f, thetaI - thetaU));
+    if (cosThetaI <= 0.f)
+    {
+        return 0.f;
+    }
+
+    return node.power * glm::cos(thetaP) * cosThetaI / distanceSquared;
+}
+
+const Sphere* LightBvh::SampleLight(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const
+{
+    pmf = 0.f;
+    if (m_nodes.empty())
+    {
+        return nullptr;
+    }
+
+    float nodePmf = 1.f;
+    int nodeIndex = 0;
+
+    while (m_nodes[nodeIndex].lightIndex < 0)
+    {
+        int firstChild = nodeIndex + 1;
+        int secondChild = m_nodes[nodeIndex].secondChild;
+
+        float importanceA = Importance(p, n, m_nodes[firstChild]);
+        float importanceB = Importance(p, n, m_nodes[secondChild]);
+        if (importanceA + importanceB <= 0.f)
+        {
+            return nullptr;
+        }
+
+        // choose a child and remap the random number for the next decision
+        float probabilityA = importanceA / (importanceA + importanceB);
+        if (u < probabilityA)
+        {
+            nodeIndex = firstChild;
+            u = glm::min(u / probabilityA, 0.99999994f);
+            nodePmf *= probabilityA;
+        }
+        else
+        {
+            nodeIndex = secondChild;
+            u = glm::min((u - probabilityA) / (1.f - probabilityA), 0.99999994f);
+            nodePmf *= (1.f - probabilityA);
+        }
+    }
+
+    pmf = nodePmf;
+    return m_lights[m_nodes[nodeIndex].lightIndex];
+}
+
+float LightBvh::Pmf(const glm::vec3& p, const glm::vec3& n, const Hitable* light) const
+{
+    auto it = m_lightIndices.find(light);
+    if (it == m_lightIndices.end())
+    {
+        return 0.f;
+    }
+
+    // walk from the leaf up to the root and multiply the probabilities of the decisions taken by SampleLight()
+    float pmf = 1.f;
+    int nodeIndex = m_leafOfLight[it->second];
+
+    while (m_nodes[nodeIndex].parent >= 0)
+    {
+        int parent = m_nodes[nodeIndex].parent;
+        int firstChild = parent + 1;
+        int secondChild = m_nodes[parent].secondChild;
+
+        float importanceA = Importance(p, n, m_nodes[firstChild]);
+        float importanceB = Importance(p, n, m_nodes[secondChild]);
+        float importance = (nodeIndex == firstChild) ? importanceA : importanceB;
+        if (importance <= 0.f)
+        {
+            return 0.f;
+        }
+
+        pmf *= importance / (importanceA + importanceB);
+        nodeIndex = parent;
+    }
+
+    return pmf;
+}
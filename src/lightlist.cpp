@@ -0,0 +1,35 @@
+#include "lightlist.h"
+
+#include "sphere.h"
+
+#include <algorithm>
+
+void LightList::AddToList(const Sphere* light)
+{
+    m_lights.push_back(light);
+}
+
+void LightList::clear()
+{
+    m_lights.clear();
+}
+
+const Sphere* LightList::SampleLight(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const
+{
+    if (m_lights.empty())
+    {
+        pmf = 0.f;
+        return nullptr;
+    }
+
+    size_t index = std::min(static_cast<size_t>(u * static_cast<float>(m_lights.size())), m_lights.size() - 1);
+    pmf = 1.f / static_cast<float>(m_lights.size());
+
+    return m_lights[index];
+}
+
+float LightList::Pmf(const glm::vec3& p, const glm::vec3& n, const Hitable* light) const
+{
+    // all emissive spheres of the scene are expected to be registered
+    return m_lights.empty() ? 0.f : 1.f / static_cast<float>(m_lights.size());
+}
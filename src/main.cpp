@@ -1,72 +1,258 @@
 #include "commonheader.h"
 
+#include "bvh.h"
 #include "camera.h"
 #include "dielectric.h"
-#include "hitablelist.h"
+#include "diffuselight.h"
 #include "lambertian.h"
+#include "lightbvh.h"
+#include "lightlist.h"
 #include "metal.h"
 #include "random.h"
 #include "renderer.h"
+#include "renderloop.h"
 #include "sphere.h"
+#include "texture.h"
+#include "texturecache.h"
 #include "viewport.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// interval in which the latest frame is presented (the display rate)
+constexpr int PRESENT_INTERVAL_MS = 16;
+
+// with --stats, the time to present a frame is logged as the mean over this many frames
+constexpr int PRESENT_STATISTICS_FRAMES = 64;
+
+void PrintUsage(const char* program)
+{
+    SDL_Log("Usage: %s [options]\n"
+        "  --lights                  night scene lit by a few small emitters\n"
+        "  --many-lights             benchmark scene with 10k small emitters\n"
+        "  --texture <file.bmp>      image texture for the small diffuse spheres\n"
+        "  --texture-cache-mb <n>    memory budget of the texture cache\n"
+        "  --guiding                 start with path guiding enabled\n"
+        "  --sampler <name>          random, sobol (default), r2 or bluenoise\n"
+        "  --adaptive [threshold]    adaptive sampling, stops at the given error of the displayed value (default 0.005)\n"
+        "  --stats                   log time, variance and efficiency per refinement iteration\n"
+        "  --threads <n>             number of render threads (default: number of hardware threads)\n"
+        "  --numa                    pin render threads to CPUs, render and place framebuffer bands per NUMA node\n"
+        "  --tile-size <n>           edge length of the square tiles in pixels (default 32)\n"
+        "  --tile-order <name>       scanline, morton or hilbert (default)\n"
+        "  --auto-tune               choose tile size and number of threads by measuring the first passes\n"
+        "  --task-queue              queue every tile as a task instead of dispatching tiles to persistent workers\n"
+        "  --foveated                refine the tiles around the mouse cursor (or the image center) first and more often\n"
+        "  --accumulation <name>     float (default), half, double, kahan or planar storage of the accumulated colors\n"
+        "  --frame-budget <ms>       render as many passes or tiles per frame as fit into the time (default: one pass per frame)\n"
+        "  --check-determinism [n]   render n passes (default 16) with 1, 4 and all threads and with another tile size and\n"
+        "                            dispatch, compare the images and exit\n",
+        program);
+}
+
 // helper function to check if two spheres intersect
 bool Intersect(glm::vec3 center1, float radius1, glm::vec3 center2, float radius2)
 {
     return glm::distance(center1, center2) <= (radius1 + radius2);
 }
 
-int main()
+// keys that change the camera, the scene or the settings of the renderer (which is only modified while the render thread is paused)
+bool ChangesRendering(SDL_Keycode key)
 {
-    // initialize SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL Init failed", SDL_GetError(), NULL);
-        return -1;
+    switch (key)
+    {
+    case SDLK_UP:
+    case SDLK_DOWN:
+    case SDLK_LEFT:
+    case SDLK_RIGHT:
+    case SDLK_l:
+    case SDLK_g:
+    case SDLK_n:
+    case SDLK_s:
+    case SDLK_f:
+    case SDLK_a:
+        return true;
+
+    default:
+        return false;
     }
+}
 
-    // create a window
-    int width = 600;
-    int height = 400;
-    SDL_Window *window;
+int main(int argc, char* argv[])
+{
+    // parse command line options
+    bool smallLightsScene = false;
+    bool manyLightsScene = false;
+    const char* textureFile = nullptr;
+    bool pathGuiding = false;
+    bool logStatistics = false;
+    SamplerType samplerType = SamplerType::Sobol;
+    AccumulationFormat accumulationFormat = AccumulationFormat::Float;
+    const float defaultAdaptiveThreshold = 0.005f;
+    float adaptiveThreshold = 0.f;
+    int numThreads = static_cast<int>(std::thread::hardware_concurrency());
+    bool topologyAware = false;
+    int tileSize = 32;
+    TileOrder tileOrder = TileOrder::Hilbert;
+    bool atomicTileDispatch = true;
+    double frameBudgetMs = 0.0;
+    bool foveation = false;
+    bool autoTuning = false;
+    int determinismCheckPasses = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--lights") == 0)
+        {
+            // night scene lit by a few small emissive spheres
+            smallLightsScene = true;
+        }
+        else if (std::strcmp(argv[i], "--many-lights") == 0)
+        {
+            // benchmark scene for light selection lit by 10k tiny emissive spheres
+            manyLightsScene = true;
+        }
+        else if (std::strcmp(argv[i], "--guiding") == 0)
+        {
+            pathGuiding = true;
+        }
+        else if (std::strcmp(argv[i], "--stats") == 0)
+        {
+            logStatistics = true;
+        }
+        else if (std::strcmp(argv[i], "--sampler") == 0 && i + 1 < argc)
+        {
+            const char* name = argv[++i];
+            int type = 0;
+            while (type < static_cast<int>(SamplerType::Count) && std::strcmp(name, GetSamplerName(static_cast<SamplerType>(type))) != 0)
+            {
+                ++type;
+            }
 
-    window = SDL_CreateWindow(
-        "Simple Raytracing",
-        SDL_WINDOWPOS_UNDEFINED,
-        SDL_WINDOWPOS_UNDEFINED,
-        width, height,
-        //SDL_WINDOW_FULLSCREEN_DESKTOP
-        SDL_WINDOW_SHOWN
-    );
+            if (type < static_cast<int>(SamplerType::Count))
+            {
+                samplerType = static_cast<SamplerType>(type);
+            }
+            else
+            {
+                SDL_Log("Unknown sampler %s", name);
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--adaptive") == 0)
+        {
+            adaptiveThreshold = defaultAdaptiveThreshold;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                adaptiveThreshold = static_cast<float>(std::atof(argv[++i]));
+            }
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            numThreads = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--numa") == 0)
+        {
+            topologyAware = true;
+        }
+        else if (std::strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc)
+        {
+            tileSize = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--tile-order") == 0 && i + 1 < argc)
+        {
+            const char* name = argv[++i];
+            if (std::strcmp(name, "scanline") == 0)
+            {
+                tileOrder = TileOrder::Scanline;
+            }
+            else if (std::strcmp(name, "morton") == 0)
+            {
+                tileOrder = TileOrder::Morton;
+            }
+            else if (std::strcmp(name, "hilbert") == 0)
+            {
+                tileOrder = TileOrder::Hilbert;
+            }
+            else
+            {
+                SDL_Log("Unknown tile order %s", name);
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--auto-tune") == 0)
+        {
+            autoTuning = true;
+        }
+        else if (std::strcmp(argv[i], "--task-queue") == 0)
+        {
+            atomicTileDispatch = false;
+        }
+        else if (std::strcmp(argv[i], "--foveated") == 0)
+        {
+            foveation = true;
+        }
+        else if (std::strcmp(argv[i], "--accumulation") == 0 && i + 1 < argc)
+        {
+            const char* name = argv[++i];
+            int format = 0;
+            while (format < static_cast<int>(AccumulationFormat::Count) && std::strcmp(name, GetAccumulationFormatName(static_cast<AccumulationFormat>(format))) != 0)
+            {
+                ++format;
+            }
 
-    if (window == nullptr)
-    {
-        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not create a window: %s.", SDL_GetError());
-        SDL_Quit();
-        return -1;
+            if (format < static_cast<int>(AccumulationFormat::Count))
+            {
+                accumulationFormat = static_cast<AccumulationFormat>(format);
+            }
+            else
+            {
+                SDL_Log("Unknown accumulation format %s", name);
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+        {
+            frameBudgetMs = std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--check-determinism") == 0)
+        {
+            determinismCheckPasses = 16;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                determinismCheckPasses = std::atoi(argv[++i]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--texture") == 0 && i + 1 < argc)
+        {
+            textureFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--texture-cache-mb") == 0 && i + 1 < argc)
+        {
+            TextureCache::GetInstance().SetMemoryBudget(static_cast<size_t>(std::atoi(argv[++i])) * 1024 * 1024);
+        }
+        else
+        {
+            SDL_Log("Unknown option %s", argv[i]);
+            PrintUsage(argv[0]);
+        }
     }
 
-    // create a drawing surface
-    SDL_Surface* s;
-    Uint32 rMask, gMask, bMask, aMask;
+    // size of the window and the image
+    int width = 600;
+    int height = 400;
 
-    // SDL interprets each pixel as a 32-bit number, so masks depend on the endianness of the system
+    // the renderer composes each pixel as a 32-bit number, so the byte order depends on the endianness of the system
 #if SDL_BYTEORDER == SDL_BIG_ENDIAN
     static_assert(false, "SDL byte order must be little endian!");
-#else
-    rMask = 0x000000ff;
-    gMask = 0x0000ff00;
-    bMask = 0x00ff0000;
-    aMask = 0xff000000;
 #endif
 
-    s = SDL_CreateRGBSurface(0, width, height, 32, rMask, gMask, bMask, aMask);
-
-    if (s == nullptr)
+    // textures
+    std::unique_ptr<ImageTexture> texture;
+    if (textureFile != nullptr)
     {
-        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not create a window: %s.", SDL_GetError());
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return -1;
+        texture = ImageTexture::LoadBMP(textureFile);
     }
 
     // Create a few materials
@@ -80,15 +266,23 @@ int main()
     std::vector<Dielectric> dielectrics;
     dielectrics.push_back(Dielectric(1.5f));
 
+    std::vector<DiffuseLight> diffuseLights;
+    diffuseLights.push_back(DiffuseLight(glm::vec3(40.f, 32.f, 24.f)));
+    diffuseLights.push_back(DiffuseLight(glm::vec3(16.f, 24.f, 40.f)));
+
+    // fixed seed, so the scene is the same in every run
+    Pcg32 rng;
+
     // create more random materials
     for (int i = 0; i < 50; ++i)
     {
-        lambertians.push_back(Lambertian(glm::vec3(GetNextRandom()*GetNextRandom(), GetNextRandom()*GetNextRandom(), GetNextRandom()*GetNextRandom())));
+        glm::vec3 albedo(rng.NextFloat()*rng.NextFloat(), rng.NextFloat()*rng.NextFloat(), rng.NextFloat()*rng.NextFloat());
+        lambertians.push_back(texture ? Lambertian(texture.get()) : Lambertian(albedo));
     }
 
     for (int i = 0; i < 50; ++i)
     {
-        metals.push_back(Metal(glm::vec3(0.5f * (1.f + GetNextRandom()), 0.5f * (1.f + GetNextRandom()), 0.5f * (1.f + GetNextRandom())), 0.4f * GetNextRandom()));
+        metals.push_back(Metal(glm::vec3(0.5f * (1.f + rng.NextFloat()), 0.5f * (1.f + rng.NextFloat()), 0.5f * (1.f + rng.NextFloat())), 0.4f * rng.NextFloat()));
     }
 
     // create a bunch of spheres
@@ -112,8 +306,8 @@ int main()
     {
         for (float b = -3.f; b < 3.5f; b += 1.5f)
         {
-            float radius = glm::clamp(0.5f * GetNextRandom(), 0.2f, 0.3f);
-            glm::vec3 center = glm::vec3(a + 0.9f * GetNextRandom(), -1.f + radius, b + 0.9f * GetNextRandom());
+            float radius = glm::clamp(0.5f * rng.NextFloat(), 0.2f, 0.3f);
+            glm::vec3 center = glm::vec3(a + 0.9f * rng.NextFloat(), -1.f + radius, b + 0.9f * rng.NextFloat());
             
             // avoid intersections with large spheres
             bool intersect = false;
@@ -126,7 +320,7 @@ int main()
                 continue;
             }
 
-            float chooseMaterial = GetNextRandom();
+            float chooseMaterial = rng.NextFloat();
 
             if (chooseMaterial < 0.7f && nextLambertian < lambertians.size())
             {
@@ -146,26 +340,213 @@ int main()
         }
     }
 
-    HitableList world;
+    // small lights floating above the scene
+    size_t firstLight = spheres.size();
+    if (smallLightsScene)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            float angle = static_cast<float>(i) * 0.785f;
+            glm::vec3 center(3.f * glm::cos(angle), 1.2f + 0.3f * static_cast<float>(i % 2), 2.f * glm::sin(angle));
+            spheres.push_back(Sphere(center, 0.06f, &diffuseLights[i % 2]));
+        }
+    }
+    else if (manyLightsScene)
+    {
+        constexpr int NUM_LIGHTS = 10000;
+        spheres.reserve(spheres.size() + NUM_LIGHTS);
+
+        for (int i = 0; i < 14; ++i)
+        {
+            diffuseLights.push_back(DiffuseLight(60.f * glm::vec3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat())));
+        }
+
+        while (spheres.size() - firstLight < NUM_LIGHTS)
+        {
+            glm::vec3 center(12.f * rng.NextFloat() - 6.f, 0.2f + 2.8f * rng.NextFloat(), 10.f * rng.NextFloat() - 5.f);
+            float radius = 0.015f;
+
+            // avoid intersections with large spheres
+            bool intersect = false;
+            for (size_t i = 1; i < 4; ++i)
+            {
+                intersect |= Intersect(center, radius, spheres[i].GetCenter(), spheres[i].GetRadius());
+            }
+            if (!intersect)
+            {
+                spheres.push_back(Sphere(center, radius, &diffuseLights[2 + spheres.size() % (diffuseLights.size() - 2)]));
+            }
+        }
+    }
+
+    std::vector<Hitable*> hitables;
     for (auto& s : spheres)
     {
-        world.AddToList(&s);
+        hitables.push_back(&s);
     }
+    Bvh world(hitables);
+
+    // light selection: importance-driven light hierarchy (and uniform selection for comparison)
+    std::vector<const Sphere*> lightSpheres;
+    LightList uniformLights;
+    for (size_t i = firstLight; i < spheres.size(); ++i)
+    {
+        lightSpheres.push_back(&spheres[i]);
+        uniformLights.AddToList(&spheres[i]);
+    }
+    LightBvh lightBvh(lightSpheres);
 
     // create a Renderer
     Viewport viewport(width, height);
-    Renderer renderer(viewport);
+    auto setupRenderer = [&](Renderer& r)
+        {
+            r.SetLightSampler(&lightBvh);
+            r.SetPathGuiding(pathGuiding);
+            r.SetSamplerType(samplerType);
+            r.SetAccumulationFormat(accumulationFormat);
+            r.SetAdaptiveSampling(adaptiveThreshold);
+            r.SetTileSize(tileSize);
+            r.SetTileOrder(tileOrder);
+            r.SetAtomicTileDispatch(atomicTileDispatch);
+            if (smallLightsScene || manyLightsScene)
+            {
+                r.SetBackgroundIntensity(0.02f);
+            }
+
+            // set initial camera perspective
+            r.GetTrackball().UpdateElevationAngle(-0.3f);
+            r.GetTrackball().SetRadius(3.3f);
+            r.GetTrackball().UpdatePolarAngle(0.5f);
+        };
+
+    if (determinismCheckPasses > 0)
+    {
+        // the same image has to come out regardless of the number of threads and how the work is split into tasks, the check
+        // renders offscreen before SDL's video subsystem is initialized, so it runs without a display (e.g., in CI)
+        struct Configuration
+        {
+            int threads;
+            int tileSize;
+            bool atomicTileDispatch;
+        };
+        const int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+        const Configuration configurations[] = {
+            { 1, tileSize, atomicTileDispatch },
+            { 4, tileSize, atomicTileDispatch },
+            { hardwareThreads, tileSize, atomicTileDispatch },
+            { 4, (tileSize == 16) ? 64 : 16, !atomicTileDispatch }
+        };
+        std::vector<uint32_t> pixels(width * height);
+        uint64_t referenceHash = 0;
+        bool identical = true;
+        for (const Configuration& configuration : configurations)
+        {
+            Renderer r(viewport, configuration.threads, topologyAware);
+            setupRenderer(r);
+            r.SetTileSize(configuration.tileSize);
+            r.SetAtomicTileDispatch(configuration.atomicTileDispatch);
+            for (int pass = 0; pass < determinismCheckPasses; ++pass)
+            {
+                r.Render(world, pixels.data());
+            }
+
+            uint64_t hash = r.GetImageHash();
+            SDL_Log("%2d threads, tile size %2d, %s dispatch, %d passes: image hash %016llx", static_cast<int>(r.GetNumThreads()),
+                configuration.tileSize, configuration.atomicTileDispatch ? "atomic" : "queued", determinismCheckPasses,
+                static_cast<unsigned long long>(hash));
+            if (&configuration == &configurations[0])
+            {
+                referenceHash = hash;
+            }
+            identical = identical && (hash == referenceHash);
+        }
+        SDL_Log("Determinism check %s", identical ? "passed" : "FAILED");
+        return identical ? 0 : 1;
+    }
+
+    // initialize SDL
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL Init failed", SDL_GetError(), NULL);
+        return -1;
+    }
 
-    // set initial camera perspective
-    renderer.GetTrackball().UpdateElevationAngle(-0.3f);
-    renderer.GetTrackball().SetRadius(3.3f);
-    renderer.GetTrackball().UpdatePolarAngle(0.5f);
+    // create a window
+    SDL_Window *window;
+
+    window = SDL_CreateWindow(
+        "Simple Raytracing",
+        SDL_WINDOWPOS_UNDEFINED,
+        SDL_WINDOWPOS_UNDEFINED,
+        width, height,
+        //SDL_WINDOW_FULLSCREEN_DESKTOP
+        SDL_WINDOW_SHOWN
+    );
+
+    if (window == nullptr)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not create a window: %s.", SDL_GetError());
+        SDL_Quit();
+        return -1;
+    }
+
+    // frames are copied into a streaming texture in the pixel format of the window (the renderer resolves in that byte order),
+    // so presenting needs neither an intermediate surface nor a conversion
+    SDL_Renderer* presenter = SDL_CreateRenderer(window, -1, 0);
+    Uint32 windowFormat = SDL_GetWindowPixelFormat(window);
+    bool rgbaWindow = (windowFormat == SDL_PIXELFORMAT_ABGR8888 || windowFormat == SDL_PIXELFORMAT_BGR888);
+    SDL_Texture* frameTexture = nullptr;
+    if (presenter != nullptr)
+    {
+        frameTexture = SDL_CreateTexture(presenter, rgbaWindow ? SDL_PIXELFORMAT_RGBA32 : SDL_PIXELFORMAT_BGRA32, SDL_TEXTUREACCESS_STREAMING, width, height);
+    }
+
+    if (frameTexture == nullptr)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not create a streaming texture: %s.", SDL_GetError());
+        if (presenter != nullptr)
+        {
+            SDL_DestroyRenderer(presenter);
+        }
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return -1;
+    }
+
+    Renderer renderer(viewport, numThreads, topologyAware);
+    setupRenderer(renderer);
+    renderer.SetPixelFormat(rgbaWindow ? PixelFormat::RGBA : PixelFormat::BGRA);
+    renderer.SetLogStatistics(logStatistics);
+    renderer.SetFrameBudget(frameBudgetMs / 1000.0);
+    renderer.SetFoveation(foveation);
+    renderer.SetAutoTuning(autoTuning);
+    SDL_Log("Rendering with %d threads (%s)", static_cast<int>(renderer.GetNumThreads()), ParallelBackend::GetName());
+
+    // the image is refined on a background thread, this thread handles input and presents the latest completed frame
+    RenderLoop renderLoop(renderer, world);
     
-    // render loop
+    // present loop
     bool terminate = false;
-    bool clearRendering = true;
+    uint32_t inputTimestamp = 0;    ///< time of the first key press that is not visible yet (0 if none)
+    double presentSeconds = 0.0;    ///< time spent presenting the last PRESENT_STATISTICS_FRAMES frames
+    int presentedFrames = 0;
     while (!terminate)
     {
+        // wake up for input or after a display interval, once the image is final (or refinement is suspended) nothing
+        // changes before the next input
+        if (renderLoop.IsIdle())
+        {
+            SDL_WaitEvent(nullptr);
+        }
+        else
+        {
+            SDL_WaitEventTimeout(nullptr, PRESENT_INTERVAL_MS);
+        }
+
+        // the renderer is only modified while the render thread is paused (which cancels the pass in flight)
+        bool paused = false;
+        bool clearRendering = false;
+        bool present = false;
+
         // Get the next event
         SDL_Event event;
         while (SDL_PollEvent(&event))
@@ -175,8 +556,32 @@ int main()
                 // Break out of the loop on quit
                 terminate = true;
             }
+            else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED)
+            {
+                present = true;
+            }
+            else if (event.type == SDL_MOUSEMOTION)
+            {
+                // the focus follows the cursor without interrupting the render thread
+                renderer.SetFocusPoint(glm::ivec2(event.motion.x, event.motion.y));
+            }
             else if (event.type == SDL_KEYDOWN)
             {
+                // other keys (e.g. suspending refinement or unbound ones) let the pass in flight finish
+                if (ChangesRendering(event.key.keysym.sym))
+                {
+                    if (!paused)
+                    {
+                        renderLoop.Pause();
+                        paused = true;
+                    }
+
+                    if (inputTimestamp == 0 && !renderLoop.IsSuspended())
+                    {
+                        inputTimestamp = glm::max(event.key.timestamp, 1u);
+                    }
+                }
+
                 Trackball& trackball = renderer.GetTrackball();
 
                 switch(event.key.keysym.sym) 
@@ -226,39 +631,136 @@ int main()
                     break;
                 }
 
+                case SDLK_l:
+                {
+                    // toggle between the light hierarchy and uniform light selection
+                    bool useLightBvh = (renderer.GetLightSampler() != &lightBvh);
+                    renderer.SetLightSampler(useLightBvh ? static_cast<const LightSampler*>(&lightBvh) : &uniformLights);
+                    SDL_Log("Light selection: %s", useLightBvh ? "light BVH" : "uniform");
+                    clearRendering = true;
+                    break;
+                }
+
+                case SDLK_g:
+                {
+                    renderer.SetPathGuiding(!renderer.GetPathGuiding());
+                    SDL_Log("Path guiding %s", renderer.GetPathGuiding() ? "enabled" : "disabled");
+                    clearRendering = true;
+                    break;
+                }
+
+                case SDLK_n:
+                {
+                    // toggle next-event estimation to compare against brute-force path tracing
+                    renderer.SetNextEventEstimation(!renderer.GetNextEventEstimation());
+                    SDL_Log("Next-event estimation %s", renderer.GetNextEventEstimation() ? "enabled" : "disabled");
+                    clearRendering = true;
+                    break;
+                }
+
+                case SDLK_s:
+                {
+                    // cycle through the samplers to compare their convergence
+                    int type = (static_cast<int>(renderer.GetSamplerType()) + 1) % static_cast<int>(SamplerType::Count);
+                    renderer.SetSamplerType(static_cast<SamplerType>(type));
+                    SDL_Log("Sampler: %s", GetSamplerName(renderer.GetSamplerType()));
+                    clearRendering = true;
+                    break;
+                }
+
+                case SDLK_f:
+                {
+                    // only the order and frequency of the tiles changes, the image stays valid
+                    renderer.SetFoveation(!renderer.GetFoveation());
+                    SDL_Log("Foveated scheduling %s", renderer.GetFoveation() ? "enabled" : "disabled");
+                    break;
+                }
+
+                case SDLK_p:
+                {
+                    // leave the CPUs to other jobs, the image is refined further after resuming
+                    renderLoop.SetSuspended(!renderLoop.IsSuspended());
+                    SDL_Log("Refinement %s", renderLoop.IsSuspended() ? "suspended" : "resumed");
+                    SDL_SetWindowTitle(window, renderLoop.IsSuspended() ? "Simple Raytracing (suspended)" : "Simple Raytracing");
+                    if (renderLoop.IsSuspended())
+                    {
+                        inputTimestamp = 0;
+                    }
+                    break;
+                }
+
+                case SDLK_a:
+                {
+                    renderer.SetAdaptiveSampling(renderer.GetAdaptiveSampling() > 0.f ? 0.f : defaultAdaptiveThreshold);
+                    SDL_Log("Adaptive sampling %s", renderer.GetAdaptiveSampling() > 0.f ? "enabled" : "disabled");
+                    clearRendering = true;
+                    break;
+                }
+
                 default:
                 break;
                 }
             }
         }
 
-        if (!terminate)
+        if (paused)
         {
             // when camera parameters changed, we need to clear the previous image
-            if (clearRendering)
+            renderLoop.Resume(clearRendering);
+        }
+
+        auto presentStart = std::chrono::steady_clock::now();
+        const uint32_t* frame = renderLoop.AcquireFrame();
+        if (!terminate && frame != nullptr)
+        {
+            // the only copy of the frame (the texture rows may be padded)
+            void* texturePixels = nullptr;
+            int pitch = 0;
+            if (SDL_LockTexture(frameTexture, nullptr, &texturePixels, &pitch) == 0)
             {
-                renderer.ClearFramebuffer();
-                clearRendering = false;
+                size_t rowBytes = static_cast<size_t>(width) * sizeof(uint32_t);
+                if (static_cast<size_t>(pitch) == rowBytes)
+                {
+                    std::memcpy(texturePixels, frame, rowBytes * static_cast<size_t>(height));
+                }
+                else
+                {
+                    for (int row = 0; row < height; ++row)
+                    {
+                        std::memcpy(static_cast<uint8_t*>(texturePixels) + static_cast<size_t>(row) * pitch, frame + static_cast<size_t>(row) * width, rowBytes);
+                    }
+                }
+                SDL_UnlockTexture(frameTexture);
             }
 
-            SDL_LockSurface(s);
-            uint32_t* pixelData = reinterpret_cast<uint32_t*>(s->pixels);
-
-            // this will render the image or refine the rendering
-            renderer.Render(world, pixelData);
-
-            SDL_UnlockSurface(s);
+            if (logStatistics && inputTimestamp != 0)
+            {
+                SDL_Log("input latency: %u ms from key press to the first image", SDL_GetTicks() - inputTimestamp);
+            }
+            inputTimestamp = 0;
+            present = true;
+        }
 
-            // blit the drawing surface to the window surface
-            auto screen = SDL_GetWindowSurface(window);
-            SDL_BlitSurface(s, nullptr, screen, nullptr);
+        if (present)
+        {
+            SDL_RenderCopy(presenter, frameTexture, nullptr, nullptr);
+            SDL_RenderPresent(presenter);
         }
 
-        SDL_UpdateWindowSurface(window);
+        if (logStatistics && frame != nullptr)
+        {
+            presentSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - presentStart).count();
+            if (++presentedFrames == PRESENT_STATISTICS_FRAMES)
+            {
+                SDL_Log("present: %.3f ms per frame at %dx%d", 1000.0 * presentSeconds / presentedFrames, width, height);
+                presentSeconds = 0.0;
+                presentedFrames = 0;
+            }
+        }
     } 
 
-    SDL_FreeSurface(s);
-    s = nullptr;
+    SDL_DestroyTexture(frameTexture);
+    SDL_DestroyRenderer(presenter);
 
     SDL_DestroyWindow(window);
 
@@ -1,23 +1,25 @@
 #include "metal.h"
 
+#include "sampling.h"
+
 Metal::Metal(const glm::vec3& a, float fuzziness)
 : m_albedo(a)
-, m_fuzziness(fuzziness)
+, m_fuzziness(glm::clamp(fuzziness, 0.f, 1.f))
 {
-    if (fuzziness > 1.f)
-    {
-        fuzziness = 1.f;
-    }
-    else if (fuzziness < 0.f)
-    {
-        fuzziness = 0.f;
-    }
+    // perturbing the reflection by at most fuzziness (in the unit sphere) bounds its deviation by asin(fuzziness)
+    m_cosFuzzCone = glm::sqrt(1.f - m_fuzziness * m_fuzziness);
 }
 
-bool Metal::Scatter(const Ray& inRay, const HitRecord& rec, glm::vec3& attenuation, Ray& scattered) const
+bool Metal::Scatter(const Ray& inRay, const HitRecord& rec, Sampler& sampler, glm::vec3& attenuation, Ray& scattered) const
 {
-    glm::vec3 reflected = glm::reflect(inRay.Direction(), rec.normal);
-    scattered = Ray(rec.p, glm::normalize(reflected + m_fuzziness * (RandomInUnitSphere())));
+    glm::vec3 reflected = glm::normalize(glm::reflect(inRay.Direction(), rec.normal));
+
+    if (m_fuzziness > 0.f)
+    {
+        reflected = SampleUniformCone(reflected, m_cosFuzzCone, sampler.Get2D());
+    }
+
+    scattered = Ray(rec.p, reflected);
     attenuation = m_albedo;
 
     return (dot(scattered.Direction(), rec.normal) > 0);
@@ -0,0 +1,93 @@
+#include "parallelbackend.h"
+
+#if defined(PARALLEL_BACKEND_OPENMP) || defined(PARALLEL_BACKEND_STDPAR)
+
+#include <algorithm>
+#include <numeric>
+
+#if defined(PARALLEL_BACKEND_OPENMP)
+#include <omp.h>
+#else
+#include <execution>
+#endif
+
+ParallelRuntime::ParallelRuntime(int numThreads, bool topologyAware)
+: m_numThreads(std::max(numThreads, 1))
+, m_numActiveThreads(m_numThreads)
+{
+    if (topologyAware)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Topology-aware rendering is only supported by the thread pool backend");
+    }
+}
+
+const char* ParallelRuntime::GetName()
+{
+#if defined(PARALLEL_BACKEND_OPENMP)
+    return "OpenMP";
+#else
+    return "C++17 parallel algorithms";
+#endif
+}
+
+void ParallelRuntime::SetNumActiveThreads(int numThreads)
+{
+    m_numActiveThreads = std::max(std::min(numThreads, m_numThreads), 1);
+}
+
+void ParallelRuntime::WaitForTasks()
+{
+    Run(static_cast<int>(m_tasks.size()), [this](int i) { m_tasks[i](); });
+    m_tasks.clear();
+}
+
+void ParallelRuntime::RunTileBatch(const TileBatch& batch)
+{
+    Run(batch.nodeOffsets[1], [&batch](int i) { batch.function(batch.tiles != nullptr ? batch.tiles[i] : i); });
+}
+
+void ParallelRuntime::ParallelFor(int begin, int end, const std::function<void(int)>& function, int grainSize)
+{
+    grainSize = std::max(grainSize, 1);
+    int numChunks = (std::max(end - begin, 0) + grainSize - 1) / grainSize;
+
+    Run(numChunks, [&](int chunk)
+        {
+            int first = begin + chunk * grainSize;
+            int last = std::min(first + grainSize, end);
+            for (int i = first; i < last; ++i)
+            {
+                function(i);
+            }
+        });
+}
+
+void ParallelRuntime::Run(int count, const std::function<void(int)>& function)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+#if defined(PARALLEL_BACKEND_OPENMP)
+    #pragma omp parallel for schedule(dynamic) num_threads(m_numActiveThreads)
+    for (int i = 0; i < count; ++i)
+    {
+        function(i);
+    }
+#else
+    // the runtime decides how many of the items run concurrently, but each one keeps taking indices until none are left
+    std::vector<int> workers(static_cast<size_t>(std::min(m_numActiveThreads, count)));
+    std::iota(workers.begin(), workers.end(), 0);
+    std::atomic<int> next(0);
+    std::for_each(std::execution::par, workers.begin(), workers.end(), [&](int)
+        {
+            for (int i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed))
+            {
+                function(i);
+            }
+        });
+#endif
+}
+
+#endif
@@ -0,0 +1,377 @@
+#include "pathguiding.h"
+
+#include "sampling.h"
+
+#include <cmath>
+
+constexpr float QUADTREE_SUBDIVISION_THRESHOLD = 0.01f;
+constexpr int QUADTREE_MAX_DEPTH = 20;
+constexpr float SPATIAL_SPLIT_FACTOR = 12000.f;
+constexpr int SPATIAL_MAX_DEPTH = 64;
+constexpr uint32_t NO_NODE = 0xFFFFFFFF;
+
+// recorded energy is summed up in fixed point, integer additions do not depend on the order in which the render
+// threads record their samples, so the learned distributions (and the images) are reproducible
+constexpr float ENERGY_SCALE = 65536.f;
+constexpr float MAX_RECORDED_VALUE = 4294967296.f;
+
+namespace
+{
+    glm::vec2 DirectionToCylindrical(const glm::vec3& d)
+    {
+        float phi = glm::atan(d.y, d.x);
+        if (phi < 0.f)
+        {
+            phi += 2.f * SAMPLING_PI;
+        }
+
+        return glm::clamp(glm::vec2(0.5f * (d.z + 1.f), phi / (2.f * SAMPLING_PI)), glm::vec2(0.f), glm::vec2(0.99999994f));
+    }
+
+    glm::vec3 CylindricalToDirection(const glm::vec2& p)
+    {
+        float cosTheta = 2.f * p.x - 1.f;
+        float sinTheta = glm::sqrt(glm::max(0.f, 1.f - cosTheta * cosTheta));
+        float phi = 2.f * SAMPLING_PI * p.y;
+
+        return glm::vec3(sinTheta * glm::cos(phi), sinTheta * glm::sin(phi), cosTheta);
+    }
+
+    int Quadrant(glm::vec2& p)
+    {
+        int x = (p.x >= 0.5f) ? 1 : 0;
+        int y = (p.y >= 0.5f) ? 1 : 0;
+        p = 2.f * p - glm::vec2(static_cast<float>(x), static_cast<float>(y));
+
+        return x | (y << 1);
+    }
+}
+
+DirectionalQuadtree::Node::Node()
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        sum[i].store(0u, std::memory_order_relaxed);
+        children[i] = 0;
+    }
+}
+
+DirectionalQuadtree::Node::Node(const Node& other)
+{
+    *this = other;
+}
+
+DirectionalQuadtree::Node& DirectionalQuadtree::Node::operator=(const Node& other)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        sum[i].store(other.sum[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        children[i] = other.children[i];
+    }
+    return *this;
+}
+
+float DirectionalQuadtree::Node::Energy(int quadrant) const
+{
+    return static_cast<float>(sum[quadrant].load(std::memory_order_relaxed)) * (1.f / ENERGY_SCALE);
+}
+
+DirectionalQuadtree::DirectionalQuadtree()
+: m_nodes(1)
+, m_numSamples(0)
+{
+}
+
+DirectionalQuadtree::DirectionalQuadtree(const DirectionalQuadtree& other)
+: m_nodes(other.m_nodes)
+, m_numSamples(other.GetNumSamples())
+{
+}
+
+DirectionalQuadtree& DirectionalQuadtree::operator=(const DirectionalQuadtree& other)
+{
+    m_nodes = other.m_nodes;
+    m_numSamples.store(other.GetNumSamples(), std::memory_order_relaxed);
+    return *this;
+}
+
+float DirectionalQuadtree::GetTotal() const
+{
+    const Node& root = m_nodes[0];
+    return root.Energy(0) + root.Energy(1) + root.Energy(2) + root.Energy(3);
+}
+
+glm::vec3 DirectionalQuadtree::Sample(glm::vec2 u, float& pdf) const
+{
+    if (GetTotal() <= 0.f)
+    {
+        pdf = UniformSpherePdf();
+        return SampleUniformSphere(u);
+    }
+
+    // descend by choosing quadrants proportional to their energy, reusing the random numbers
+    glm::vec2 origin(0.f);
+    float size = 1.f;
+    float squarePdf = 1.f;
+    uint32_t nodeIndex = 0;
+
+    while (true)
+    {
+        const Node& node = m_nodes[nodeIndex];
+        float s[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            s[i] = node.Energy(i);
+        }
+        float total = s[0] + s[1] + s[2] + s[3];
+
+        // choose the column, then the row within it
+        float left = s[0] + s[2];
+        float pLeft = left / total;
+        int x;
+        if (u.x < pLeft)
+        {
+            x = 0;
+            u.x = u.x / pLeft;
+        }
+        else
+        {
+            x = 1;
+            u.x = (u.x - pLeft) / (1.f - pLeft);
+        }
+
+        float column = (x == 0) ? left : (s[1] + s[3]);
+        float pBottom = s[x] / column;
+        int y;
+        if (u.y < pBottom)
+        {
+            y = 0;
+            u.y = u.y / pBottom;
+        }
+        else
+        {
+            y = 1;
+            u.y = (u.y - pBottom) / (1.f - pBottom);
+        }
+        u = glm::min(u, glm::vec2(0.99999994f));
+
+        int quadrant = x | (y << 1);
+        squarePdf *= 4.f * s[quadrant] / total;
+        size *= 0.5f;
+        origin += size * glm::vec2(static_cast<float>(x), static_cast<float>(y));
+
+        if (node.children[quadrant] == 0)
+        {
+            break;
+        }
+        nodeIndex = node.children[quadrant];
+    }
+
+    // the cylindrical mapping is area preserving, so the density on the sphere is the density on the square over 4 pi
+    pdf = squarePdf * UniformSpherePdf();
+    return CylindricalToDirection(origin + size * u);
+}
+
+float DirectionalQuadtree::Pdf(const glm::vec3& direction) const
+{
+    if (GetTotal() <= 0.f)
+    {
+        return UniformSpherePdf();
+    }
+
+    glm::vec2 p = DirectionToCylindrical(direction);
+    float squarePdf = 1.f;
+    uint32_t nodeIndex = 0;
+
+    while (true)
+    {
+        const Node& node = m_nodes[nodeIndex];
+        float total = node.Energy(0) + node.Energy(1) + node.Energy(2) + node.Energy(3);
+        if (total <= 0.f)
+        {
+            return 0.f;
+        }
+
+        int quadrant = Quadrant(p);
+        squarePdf *= 4.f * node.Energy(quadrant) / total;
+
+        if (node.children[quadrant] == 0 || squarePdf == 0.f)
+        {
+            break;
+        }
+        nodeIndex = node.children[quadrant];
+    }
+
+    return squarePdf * UniformSpherePdf();
+}
+
+void DirectionalQuadtree::Record(const glm::vec3& direction, float value)
+{
+    m_numSamples.fetch_add(1, std::memory_order_relaxed);
+
+    if (!(value > 0.f) || !std::isfinite(value))
+    {
+        return;
+    }
+
+    uint64_t quantized = static_cast<uint64_t>(glm::min(value, MAX_RECORDED_VALUE) * ENERGY_SCALE);
+    if (quantized == 0u)
+    {
+        return;
+    }
+
+    // values are only stored in the leaf quadrants, Build() sums them up
+    glm::vec2 p = DirectionToCylindrical(direction);
+    uint32_t nodeIndex = 0;
+
+    while (true)
+    {
+        int quadrant = Quadrant(p);
+        uint32_t child = m_nodes[nodeIndex].children[quadrant];
+        if (child == 0)
+        {
+            m_nodes[nodeIndex].sum[quadrant].fetch_add(quantized, std::memory_order_relaxed);
+            return;
+        }
+        nodeIndex = child;
+    }
+}
+
+void DirectionalQuadtree::Build()
+{
+    BuildRecursive(0);
+}
+
+uint64_t DirectionalQuadtree::BuildRecursive(uint32_t nodeIndex)
+{
+    uint64_t total = 0u;
+    for (int i = 0; i < 4; ++i)
+    {
+        uint32_t child = m_nodes[nodeIndex].children[i];
+        if (child != 0)
+        {
+            m_nodes[nodeIndex].sum[i].store(BuildRecursive(child), std::memory_order_relaxed);
+        }
+        total += m_nodes[nodeIndex].sum[i].load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+void DirectionalQuadtree::Refine(const DirectionalQuadtree& previous, float subdivisionThreshold, int maxDepth)
+{
+    m_nodes.assign(1, Node());
+    m_numSamples.store(0, std::memory_order_relaxed);
+
+    float total = previous.GetTotal();
+    if (total > 0.f)
+    {
+        RefineRecursive(previous, 0, 0, 1.f, total, 1, subdivisionThreshold, maxDepth);
+    }
+}
+
+void DirectionalQuadtree::RefineRecursive(const DirectionalQuadtree& previous, uint32_t previousIndex, uint32_t nodeIndex, float fraction, float total, int depth, float subdivisionThreshold, int maxDepth)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        // quadrants that did not exist in the previous tree (previousIndex == NO_NODE) get an even share of their parent's energy
+        float quadrantFraction = 0.25f * fraction;
+        uint32_t previousChild = NO_NODE;
+        if (previousIndex != NO_NODE)
+        {
+            quadrantFraction = previous.m_nodes[previousIndex].Energy(i) / total;
+            if (previous.m_nodes[previousIndex].children[i] != 0)
+            {
+                previousChild = previous.m_nodes[previousIndex].children[i];
+            }
+        }
+
+        if (depth < maxDepth && quadrantFraction > subdivisionThreshold)
+        {
+            uint32_t child = static_cast<uint32_t>(m_nodes.size());
+            m_nodes.push_back(Node());
+            m_nodes[nodeIndex].children[i] = child;
+
+            RefineRecursive(previous, previousChild, child, quadrantFraction, total, depth + 1, subdivisionThreshold, maxDepth);
+        }
+    }
+}
+
+GuidingField::GuidingField(const Aabb& bounds)
+: m_bounds(bounds)
+, m_iteration(0)
+{
+    m_nodes.push_back(Node{ { -1, -1 }, 0, 0 });
+    m_leaves.resize(1);
+}
+
+GuidingField::Leaf& GuidingField::GetLeaf(const glm::vec3& p)
+{
+    glm::vec3 extent = glm::max(m_bounds.Extent(), glm::vec3(1e-6f));
+    glm::vec3 q = glm::clamp((p - m_bounds.Min()) / extent, glm::vec3(0.f), glm::vec3(0.99999994f));
+
+    int nodeIndex = 0;
+    while (m_nodes[nodeIndex].leafIndex < 0)
+    {
+        const Node& node = m_nodes[nodeIndex];
+        int side = (q[node.axis] >= 0.5f) ? 1 : 0;
+        q[node.axis] = 2.f * q[node.axis] - static_cast<float>(side);
+        nodeIndex = node.children[side];
+    }
+
+    return m_leaves[m_nodes[nodeIndex].leafIndex];
+}
+
+void GuidingField::EndIteration()
+{
+    // regions with many samples get split (the threshold grows as the iterations get longer)
+    uint32_t threshold = static_cast<uint32_t>(SPATIAL_SPLIT_FACTOR * glm::sqrt(static_cast<float>(1 << glm::min(m_iteration, 30))));
+    SplitRecursive(0, 0, threshold);
+
+    for (auto& leaf : m_leaves)
+    {
+        leaf.building.Build();
+        leaf.sampling = leaf.building;
+        leaf.building.Refine(leaf.sampling, QUADTREE_SUBDIVISION_THRESHOLD, QUADTREE_MAX_DEPTH);
+    }
+
+    m_iteration++;
+}
+
+void GuidingField::SplitRecursive(int nodeIndex, int depth, uint32_t threshold)
+{
+    if (m_nodes[nodeIndex].leafIndex < 0)
+    {
+        SplitRecursive(m_nodes[nodeIndex].children[0], depth + 1, threshold);
+        SplitRecursive(m_nodes[nodeIndex].children[1], depth + 1, threshold);
+    }
+    else
+    {
+        SplitLeaf(nodeIndex, depth, m_leaves[m_nodes[nodeIndex].leafIndex].building.GetNumSamples(), threshold);
+    }
+}
+
+void GuidingField::SplitLeaf(int nodeIndex, int depth, uint32_t numSamples, uint32_t threshold)
+{
+    if (depth >= SPATIAL_MAX_DEPTH || numSamples <= threshold)
+    {
+        return;
+    }
+
+    // both halves start with the records of the parent, its samples are assumed to be split evenly among them
+    int leafIndex = m_nodes[nodeIndex].leafIndex;
+    int secondLeaf = static_cast<int>(m_leaves.size());
+    m_leaves.push_back(m_leaves[leafIndex]);
+
+    int firstChild = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(Node{ { -1, -1 }, 0, leafIndex });
+    m_nodes.push_back(Node{ { -1, -1 }, 0, secondLeaf });
+
+    m_nodes[nodeIndex].children[0] = firstChild;
+    m_nodes[nodeIndex].children[1] = firstChild + 1;
+    m_nodes[nodeIndex].axis = depth % 3;
+    m_nodes[nodeIndex].leafIndex = -1;
+
+    SplitLeaf(firstChild, depth + 1, numSamples / 2, threshold);
+    SplitLeaf(firstChild + 1, depth + 1, numSamples / 2, threshold);
+}
@@ -1,54 +1,146 @@
 #include "renderer.h"
 
 #include "material.h"
-#include "random.h"
+#include "pathguiding.h"
+#include "sampling.h"
+#include "sphere.h"
 
+#include <chrono>
+#include <algorithm>
 #include <cstring>
 
-#define NUM_SAMPLES 4
-#if NUM_SAMPLES == 4
-    #define USE_4X_MSAA
-#endif
-#ifdef USE_4X_MSAA
-const std::vector<glm::vec2> Renderer::ms_samples = { glm::vec2(1.f/8.f, 5.f/8.f), glm::vec2(3.f/8.f, 1.f/8.f), glm::vec2(5.f/8.f, 7.f/8.f), glm::vec2(7.f/8.f, 3.f/8.f) };
-#elif NUM_SAMPLES > 1
-// perform random sampling
-const std::vector<glm::vec2> Renderer::ms_samples = []()
-    { 
-        std::vector<glm::vec2> samples;
-        for (int i = 0; i < NUM_SAMPLES; ++i)
-        {
-            samples.push_back(glm::vec2(GetNextRandom(), GetNextRandom()));
-        }
-        return samples;
-    }();
-#else
-const std::vector<glm::vec2> Renderer::ms_samples = { glm::vec2(0.5f, 0.5f) };
-#endif
-
-const float Renderer::ms_weightingFactor = 1.f / static_cast<float>(Renderer::ms_samples.size());
-
-constexpr int NUM_LINES_PER_RENDER_TASK = 12;
+// camera rays per pixel and refinement iteration
+constexpr int SAMPLES_PER_PASS = 4;
+
+// rows of the per-pixel buffers of floats and pass counts start on cache lines (the accumulation format may need more pixels)
+constexpr int PIXEL_ALIGNMENT = GetCacheLinePixels(sizeof(float));
 constexpr int NUM_MAX_REFINEMENTS = 2048;
 
-Renderer::Renderer(const Viewport& v) 
-: m_threadPool()
-, m_viewport(v)
-, m_currentRefinementIteration(0)
+// rows of the image that a thread resolves at once
+constexpr int RESOLVE_ROWS_PER_CHUNK = 8;
+// buffers into which the resolved tiles are tracked (a triple buffer needs three)
+constexpr size_t MAX_RESOLVED_BUFFERS = 4;
+
+// weight of the latest measurement in the moving averages of the tile and resolve times (frame budget)
+constexpr double COST_SMOOTHING = 0.25;
+
+constexpr float EPSILON = 0.0001f;
+constexpr int MAX_DEPTH = 50;
+
+// sampler dimensions: the subpixel position comes first, then every bounce uses the same fixed block
+// (light selection and position for next-event estimation, then the scattering direction)
+constexpr uint32_t PIXEL_DIMENSIONS = 2;
+constexpr uint32_t LIGHT_DIMENSIONS = 3;
+constexpr uint32_t DIMENSIONS_PER_BOUNCE = 6;
+
+// fraction of directions at non-specular surfaces sampled from the guiding distribution (the rest uses the BSDF)
+constexpr float GUIDING_FRACTION = 0.5f;
+// training iterations double in length, after this many the guiding distributions are not refined anymore
+constexpr int MAX_GUIDING_ITERATIONS = 10;
+
+// adaptive sampling: passes before a pixel may be considered converged (so that rare paths had a chance to show up)
+constexpr uint32_t MIN_ADAPTIVE_PASSES = 8;
+
+// foveation: radius around the focus point (relative to the image diagonal) in which tiles get every pass, the interval
+// doubles with every doubling of the distance up to 2^MAX_FOVEATION_LEVEL passes
+constexpr float FOVEA_RADIUS = 0.15f;
+constexpr int MAX_FOVEATION_LEVEL = 3;
+
+namespace
 {
-    // compute number of tasks for multi-threaded rendering
-    int numTasks = m_viewport.GetHeight() / NUM_LINES_PER_RENDER_TASK;
-    if (m_viewport.GetHeight() % NUM_LINES_PER_RENDER_TASK != 0)
+    float Luminance(const glm::vec3& c)
     {
-        numTasks++;
+        return glm::dot(c, glm::vec3(0.2126f, 0.7152f, 0.0722f));
     }
 
-    m_numRenderTasks = numTasks;
+    /// path vertex at which the incident radiance is recorded for path guiding
+    struct GuidingVertex
+    {
+        DirectionalQuadtree* tree;
+        glm::vec3 direction;
+        glm::vec3 throughput;   ///< throughput including the scattering at the vertex
+        glm::vec3 radiance;     ///< incident radiance along direction
+        float pdf;
+    };
 
+    /// Position of the d-th cell on the Z-order curve
+    void MortonDecode(uint32_t d, int& x, int& y)
+    {
+        x = 0;
+        y = 0;
+        for (int bit = 0; bit < 16; ++bit)
+        {
+            x |= static_cast<int>((d >> (2 * bit)) & 1u) << bit;
+            y |= static_cast<int>((d >> (2 * bit + 1)) & 1u) << bit;
+        }
+    }
+
+    /// Position of the d-th cell on the Hilbert curve through an n x n grid (n a power of two)
+    void HilbertDecode(int n, uint32_t d, int& x, int& y)
+    {
+        x = 0;
+        y = 0;
+        for (int s = 1; s < n; s *= 2)
+        {
+            int rx = static_cast<int>((d >> 1) & 1u);
+            int ry = static_cast<int>((d ^ static_cast<uint32_t>(rx)) & 1u);
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+            x += s * rx;
+            y += s * ry;
+            d >>= 2;
+        }
+    }
+}
+
+Renderer::Renderer(const Viewport& v, int numThreads, bool topologyAware) 
+: m_threadPool(numThreads, topologyAware)
+, m_viewport(v)
+, m_lightSampler(nullptr)
+, m_nextEventEstimation(true)
+, m_backgroundIntensity(1.f)
+, m_pathGuiding(false)
+, m_guidingPasses(0)
+, m_samplerType(SamplerType::Sobol)
+, m_tileSize(32)
+, m_tileOrder(TileOrder::Hilbert)
+, m_atomicTileDispatch(true)
+, m_adaptiveThreshold(0.f)
+, m_pixelFormat(PixelFormat::RGBA)
+, m_foveation(false)
+, m_focusX(v.GetWidth() / 2)
+, m_focusY(v.GetHeight() / 2)
+, m_passScheduled(false)
+, m_logStatistics(false)
+, m_passSquaredError(0.0)
+, m_passErrorPixels(0.0)
+, m_frameBudget(0.0)
+, m_passSeconds(0.0)
+, m_passBusySeconds(0.0)
+, m_passPixels(0.0)
+, m_resolveSeconds(0.0)
+, m_autoTuning(false)
+, m_currentRefinementIteration(0)
+, m_frameGeneration(0)
+, m_passGeneration(0)
+{
     // resize and initialize the accumulated frame buffer
-    m_accumulationBuffer.resize(m_viewport.GetHeight() * m_viewport.GetWidth());
+    m_accumulationBuffer = CreateAccumulationBuffer(AccumulationFormat::Float);
+    ResizeFramebuffer();
+
+    // split the image into tasks for multi-threaded rendering
+    BuildTiles();
     ClearFramebuffer();
-}    
+}
+
+Renderer::~Renderer() = default;    
 
 /// Just a simple gradient for background color
 glm::vec3 Renderer::BackgroundColor(const Ray& r) const
@@ -56,125 +148,1028 @@ glm::vec3 Renderer::BackgroundColor(const Ray& r) const
     glm::vec3 unitDirection = glm::normalize(r.Direction());
     float t = 0.5f * (unitDirection.y + 1.f);
 
-    return glm::mix(glm::vec3(1.f), glm::vec3(0.5f, 0.7f, 1.f), t);
+    return m_backgroundIntensity * glm::mix(glm::vec3(1.f), glm::vec3(0.5f, 0.7f, 1.f), t);
 }
 
-/// recursive single-bounce diffuse reflection color computation
-glm::vec3 Renderer::ComputeColor(const Ray& r, const Hitable& world, int depth) const
+/// path tracing with next-event estimation and (optionally) guided sampling at non-specular surfaces
+glm::vec3 Renderer::ComputeColor(const Ray& r, const Hitable& world, Sampler& sampler) const
 {
-    constexpr float EPSILON = 0.0001f;
-    constexpr int MAX_DEPTH = 50;
+    const bool sampleLights = (m_nextEventEstimation && m_lightSampler != nullptr);
+    GuidingField* guidingField = m_pathGuiding ? m_guidingField.get() : nullptr;
+
+    glm::vec3 color(0.f);
+    glm::vec3 throughput(1.f);
+    Ray ray = r;
+
+    GuidingVertex guidingVertices[MAX_DEPTH];
+    int numGuidingVertices = 0;
 
-    HitRecord rec;
-    if (world.Hit(r, EPSILON, std::numeric_limits<float>::max(), rec))
+    // adds radiance arriving at the camera, which also arrives at all previous guiding vertices
+    auto addContribution = [&](const glm::vec3& contribution)
+        {
+            color += contribution;
+            for (int i = 0; i < numGuidingVertices; ++i)
+            {
+                const glm::vec3& t = guidingVertices[i].throughput;
+                guidingVertices[i].radiance += glm::vec3(t.x > 0.f ? contribution.x / t.x : 0.f, t.y > 0.f ? contribution.y / t.y : 0.f, t.z > 0.f ? contribution.z / t.z : 0.f);
+            }
+        };
+
+    // information about the previous bounce for weighting emitters that are hit by BSDF sampling
+    bool specularBounce = true;
+    float bsdfPdf = 0.f;
+    glm::vec3 prevPosition(0.f);
+    glm::vec3 prevNormal(0.f);
+
+    for (int depth = 0; ; ++depth)
     {
+        HitRecord rec;
+        if (!world.Hit(ray, EPSILON, std::numeric_limits<float>::max(), rec))
+        {
+            addContribution(throughput * BackgroundColor(ray));
+            break;
+        }
+
+        bool textured = rec.material->IsTextured();
+        if (textured)
+        {
+            rec.object->ComputeTextureCoordinates(rec);
+        }
+        rec.ComputeDifferentials(ray, textured);
+
+        glm::vec3 emitted = rec.material->Emitted(ray, rec);
+        if (emitted != glm::vec3(0.f))
+        {
+            float weight = 1.f;
+            if (sampleLights && !specularBounce)
+            {
+                // the emitter could also have been found by light sampling at the previous vertex
+                const Sphere* light = static_cast<const Sphere*>(rec.object);
+                float lightPdf = m_lightSampler->Pmf(prevPosition, prevNormal, rec.object) * light->DirectionPdf(prevPosition);
+                weight = PowerHeuristic(bsdfPdf, lightPdf);
+            }
+            addContribution(throughput * emitted * weight);
+        }
+
+        if (depth >= MAX_DEPTH)
+        {
+            break;
+        }
+
+        uint32_t bounceDimension = PIXEL_DIMENSIONS + static_cast<uint32_t>(depth) * DIMENSIONS_PER_BOUNCE;
+        sampler.SetDimension(bounceDimension);
+
+        GuidingField::Leaf* guidingLeaf = nullptr;
+        if (guidingField != nullptr && !rec.material->IsSpecular())
+        {
+            guidingLeaf = &guidingField->GetLeaf(rec.p);
+        }
+
+        if (sampleLights && !rec.material->IsSpecular())
+        {
+            addContribution(throughput * SampleDirectLight(ray, rec, world, guidingLeaf ? &guidingLeaf->sampling : nullptr, sampler));
+        }
+        sampler.SetDimension(bounceDimension + LIGHT_DIMENSIONS);
+
         Ray scattered(glm::vec3(0.f), glm::vec3(0.f));
         glm::vec3 attenuation;
 
-        if (depth < MAX_DEPTH && rec.material->Scatter(r, rec, attenuation, scattered))
+        if (guidingLeaf != nullptr)
         {
-            return attenuation * ComputeColor(scattered, world, depth+1);
+            // one-sample mixture of guided and BSDF sampling
+            glm::vec3 wi;
+            float guidePdf = 0.f;
+            if (sampler.Get1D() < GUIDING_FRACTION)
+            {
+                wi = guidingLeaf->sampling.Sample(sampler.Get2D(), guidePdf);
+            }
+            else
+            {
+                if (!rec.material->Scatter(ray, rec, sampler, attenuation, scattered))
+                {
+                    break;
+                }
+                wi = scattered.Direction();
+                guidePdf = guidingLeaf->sampling.Pdf(wi);
+            }
+
+            float pdf = GUIDING_FRACTION * guidePdf + (1.f - GUIDING_FRACTION) * rec.material->Pdf(ray, rec, wi);
+            glm::vec3 f = rec.material->Evaluate(ray, rec, wi);
+            if (pdf <= 0.f || f == glm::vec3(0.f))
+            {
+                break;
+            }
+
+            scattered = Ray(rec.p, wi);
+            attenuation = f / pdf;
+            bsdfPdf = pdf;
+            specularBounce = false;
+
+            guidingVertices[numGuidingVertices++] = GuidingVertex{ &guidingLeaf->building, wi, throughput * attenuation, glm::vec3(0.f), pdf };
         }
         else
         {
-            return glm::vec3(0.f);
+            if (!rec.material->Scatter(ray, rec, sampler, attenuation, scattered))
+            {
+                break;
+            }
+
+            specularBounce = rec.material->IsSpecular();
+            if (!specularBounce)
+            {
+                bsdfPdf = rec.material->Pdf(ray, rec, scattered.Direction());
+            }
+        }
+        prevPosition = rec.p;
+        prevNormal = rec.normal;
+
+        // secondary rays keep the footprint of the current hit (parallel differentials)
+        if (ray.HasDifferentials())
+        {
+            scattered.SetDifferentials(rec.p + rec.dpdx, scattered.Direction(), rec.p + rec.dpdy, scattered.Direction());
         }
+
+        throughput *= attenuation;
+        ray = scattered;
     }
-    else
+
+    for (int i = 0; i < numGuidingVertices; ++i)
+    {
+        const GuidingVertex& v = guidingVertices[i];
+        v.tree->Record(v.direction, Luminance(v.radiance) / v.pdf);
+    }
+
+    return color;
+}
+
+/// light sampling part of next-event estimation (MIS weighted against BSDF sampling)
+glm::vec3 Renderer::SampleDirectLight(const Ray& r, const HitRecord& rec, const Hitable& world, const DirectionalQuadtree* guide, Sampler& sampler) const
+{
+    float lightPmf;
+    const Sphere* light = m_lightSampler->SampleLight(rec.p, rec.normal, sampler.Get1D(), lightPmf);
+    if (light == nullptr || lightPmf == 0.f)
+    {
+        return glm::vec3(0.f);
+    }
+
+    float directionPdf;
+    glm::vec3 wi = light->SampleDirection(rec.p, sampler.Get2D(), directionPdf);
+    if (directionPdf == 0.f)
     {
-        return BackgroundColor(r);
+        return glm::vec3(0.f);
     }
+
+    glm::vec3 f = rec.material->Evaluate(r, rec, wi);
+    if (f == glm::vec3(0.f))
+    {
+        return glm::vec3(0.f);
+    }
+
+    // find the point on the light and check if the closest hit along the shadow ray is the light itself
+    Ray shadowRay(rec.p, wi);
+    HitRecord lightRec;
+    if (!world.Hit(shadowRay, EPSILON, std::numeric_limits<float>::max(), lightRec) || lightRec.object != light)
+    {
+        return glm::vec3(0.f);
+    }
+
+    float lightPdf = lightPmf * directionPdf;
+    float bsdfPdf = rec.material->Pdf(r, rec, wi);
+    if (guide != nullptr)
+    {
+        bsdfPdf = GUIDING_FRACTION * guide->Pdf(wi) + (1.f - GUIDING_FRACTION) * bsdfPdf;
+    }
+    float weight = PowerHeuristic(lightPdf, bsdfPdf);
+
+    return f * light->GetMaterial()->Emitted(shadowRay, lightRec) * (weight / lightPdf);
+}
+
+void Renderer::ResizeFramebuffer()
+{
+    // rows are padded, so that tiles at multiples of the alignment start on cache lines of all buffers
+    int alignment = glm::max(PIXEL_ALIGNMENT, m_accumulationBuffer->GetPixelAlignment());
+    m_rowStride = (m_viewport.GetWidth() + alignment - 1) / alignment * alignment;
+    size_t numPixels = static_cast<size_t>(m_viewport.GetHeight()) * m_rowStride;
+    m_accumulationBuffer->Resize(numPixels);
+    m_luminanceSquaredSums.resize(numPixels);
+    m_pixelPasses.resize(numPixels);
 }
 
 void Renderer::ClearFramebuffer()
 {
-    std::memset(m_accumulationBuffer.data(), 0, m_accumulationBuffer.size() * sizeof(glm::vec3));
+    m_tilePasses.assign(m_tiles.size(), 0u);
+    ResetActiveTasks();
+
+    // the tiles are cleared by the threads that render them (which also first touches the pages of a new framebuffer)
+    TileBatch batch{ m_activeTasks.data(), m_nodeOffsets.data(), [this](int t) { ClearTile(t); } };
+    m_threadPool.RunTileBatch(batch);
+
     m_currentRefinementIteration = 0;
+    m_statisticsSeconds = 0.0;
+    m_statisticsVarianceSum = 0.0;
+    m_statisticsVariancePasses = 0;
+}
+
+uint64_t Renderer::GetImageHash() const
+{
+    // FNV-1a over the raw bytes
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto hashBytes = [&hash](const void* data, size_t size)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            }
+        };
+
+    hash = m_accumulationBuffer->Hash(hash);
+    hashBytes(m_pixelPasses.data(), m_pixelPasses.size() * sizeof(uint32_t));
+
+    return hash;
+}
+
+void Renderer::SetAdaptiveSampling(float threshold)
+{
+    m_adaptiveThreshold = threshold;
+
+    // pixels that were converged for the previous threshold may need more samples
+    ResetActiveTasks();
+}
+
+void Renderer::SetFoveation(bool enabled)
+{
+    m_foveation = enabled;
+    m_passScheduled = false;
+}
+
+void Renderer::SetFocusPoint(const glm::ivec2& point)
+{
+    m_focusX.store(point.x, std::memory_order_relaxed);
+    m_focusY.store(point.y, std::memory_order_relaxed);
+}
+
+void Renderer::SetAutoTuning(bool enabled)
+{
+    m_autoTuning = enabled;
+    if (enabled)
+    {
+        m_autoTuner.Reset(static_cast<int>(m_threadPool.GetNumThreads()));
+        ApplyTuning();
+    }
+    else
+    {
+        m_threadPool.SetNumActiveThreads(static_cast<int>(m_threadPool.GetNumThreads()));
+    }
+}
+
+void Renderer::ApplyTuning()
+{
+    const AutoTuner::Config& config = m_autoTuner.GetConfig();
+    if (config.tileSize != m_tileSize)
+    {
+        SetTileSize(config.tileSize);
+    }
+    m_threadPool.SetNumActiveThreads(config.numThreads);
+}
+
+void Renderer::SetTileSize(int size)
+{
+    m_tileSize = glm::max(size, 1);
+    BuildTiles();
+}
+
+void Renderer::SetAccumulationFormat(AccumulationFormat format)
+{
+    if (format == m_accumulationBuffer->GetFormat())
+    {
+        return;
+    }
+
+    // the row stride depends on the size of the pixels, so all buffers are resized
+    m_accumulationBuffer = CreateAccumulationBuffer(format);
+    ResizeFramebuffer();
+    ClearFramebuffer();
+}
+
+void Renderer::SetPixelFormat(PixelFormat format)
+{
+    // buffers resolved in the other format are written completely again
+    m_pixelFormat = format;
+    m_resolvedBuffers.clear();
+}
+
+void Renderer::SetTileOrder(TileOrder order)
+{
+    m_tileOrder = order;
+    BuildTiles();
+}
+
+void Renderer::BuildTiles()
+{
+    int tilesX = (m_viewport.GetWidth() + m_tileSize - 1) / m_tileSize;
+    int tilesY = (m_viewport.GetHeight() + m_tileSize - 1) / m_tileSize;
+
+    auto addTile = [&](int tx, int ty)
+        {
+            Tile tile;
+            tile.x = tx * m_tileSize;
+            tile.y = ty * m_tileSize;
+            tile.width = glm::min(m_tileSize, m_viewport.GetWidth() - tile.x);
+            tile.height = glm::min(m_tileSize, m_viewport.GetHeight() - tile.y);
+            m_tiles.push_back(tile);
+        };
+
+    m_tiles.clear();
+    if (m_tileOrder == TileOrder::Scanline)
+    {
+        for (int ty = 0; ty < tilesY; ++ty)
+        {
+            for (int tx = 0; tx < tilesX; ++tx)
+            {
+                addTile(tx, ty);
+            }
+        }
+    }
+    else
+    {
+        // walk the curve through the enclosing power-of-two grid and skip cells outside of the image
+        int n = 1;
+        while (n < tilesX || n < tilesY)
+        {
+            n *= 2;
+        }
+
+        for (uint32_t d = 0; d < static_cast<uint32_t>(n * n); ++d)
+        {
+            int tx, ty;
+            if (m_tileOrder == TileOrder::Morton)
+            {
+                MortonDecode(d, tx, ty);
+            }
+            else
+            {
+                HilbertDecode(n, d, tx, ty);
+            }
+
+            if (tx < tilesX && ty < tilesY)
+            {
+                addTile(tx, ty);
+            }
+        }
+    }
+
+    // each node gets a band of tile rows, so the framebuffer pages of different nodes do not overlap
+    m_tileNodes.resize(m_tiles.size());
+    for (size_t t = 0; t < m_tiles.size(); ++t)
+    {
+        m_tileNodes[t] = (m_tiles[t].y / m_tileSize) * m_threadPool.GetNumNodes() / tilesY;
+    }
+
+    m_tileSquaredErrors.assign(m_tiles.size(), 0.0);
+    m_tileErrorPixels.assign(m_tiles.size(), 0);
+    m_tileConverged.assign(m_tiles.size(), 0);
+    m_tileSeconds.assign(m_tiles.size(), 0.f);
+    m_tileLastSeconds.assign(m_tiles.size(), 0.f);
+
+    // buffers are resolved completely with new tiles
+    m_tileVersions.assign(m_tiles.size(), 1u);
+    m_resolvedBuffers.clear();
+
+    // new tiles continue with the passes of their pixels (the buffers are only initialized by the first clear)
+    bool cleared = !m_tilePasses.empty();
+    m_tilePasses.assign(m_tiles.size(), 0u);
+    for (size_t t = 0; t < m_tiles.size() && cleared; ++t)
+    {
+        const Tile& tile = m_tiles[t];
+        for (int row = tile.y; row < tile.y + tile.height; ++row)
+        {
+            const uint32_t* passes = &m_pixelPasses[static_cast<size_t>(row) * m_rowStride + tile.x];
+            m_tilePasses[t] = glm::max(m_tilePasses[t], *std::max_element(passes, passes + tile.width));
+        }
+    }
+    ResetActiveTasks();
+}
+
+void Renderer::ClearTile(int tileIndex)
+{
+    const Tile& tile = m_tiles[tileIndex];
+
+    // the tiles of the last column also clear the padding of the rows
+    int width = (tile.x + tile.width == m_viewport.GetWidth()) ? m_rowStride - tile.x : tile.width;
+    for (int row = tile.y; row < tile.y + tile.height; ++row)
+    {
+        size_t index = static_cast<size_t>(row) * m_rowStride + tile.x;
+        m_accumulationBuffer->Clear(index, width);
+        std::memset(&m_luminanceSquaredSums[index], 0, width * sizeof(float));
+        std::memset(&m_pixelPasses[index], 0, width * sizeof(uint32_t));
+    }
+    m_tileVersions[tileIndex]++;
+}
+
+void Renderer::ResetActiveTasks()
+{
+    // tiles that got the maximum number of passes stay done
+    m_activeTasks.clear();
+    for (size_t t = 0; t < m_tiles.size(); ++t)
+    {
+        if (m_tilePasses[t] < static_cast<uint32_t>(NUM_MAX_REFINEMENTS))
+        {
+            m_activeTasks.push_back(static_cast<int>(t));
+        }
+    }
+
+    // grouped by node, in the tile order within each node
+    std::stable_sort(m_activeTasks.begin(), m_activeTasks.end(), [this](int a, int b) { return m_tileNodes[a] < m_tileNodes[b]; });
+    UpdateNodeOffsets();
 }
 
-void Renderer::Render(const Hitable& world, uint32_t* pixelData)
+void Renderer::UpdateNodeOffsets()
 {
-    if (m_currentRefinementIteration < NUM_MAX_REFINEMENTS)
+    m_nodeOffsets.assign(m_threadPool.GetNumNodes() + 1, 0);
+    for (int t : m_activeTasks)
+    {
+        m_nodeOffsets[m_tileNodes[t] + 1]++;
+    }
+    for (size_t n = 1; n < m_nodeOffsets.size(); ++n)
+    {
+        m_nodeOffsets[n] += m_nodeOffsets[n - 1];
+    }
+
+    // the schedule changed, the next pass starts from the beginning
+    m_passScheduled = false;
+    m_passSeconds = 0.0;
+    m_passBusySeconds = 0.0;
+    m_passPixels = 0.0;
+    m_passSquaredError = 0.0;
+    m_passErrorPixels = 0.0;
+}
+
+template <typename Storage>
+bool Renderer::IsPixelConverged(const Storage& accumulation, size_t index) const
+{
+    uint32_t n = m_pixelPasses[index];
+    if (m_adaptiveThreshold <= 0.f || n < MIN_ADAPTIVE_PASSES)
+    {
+        return false;
+    }
+
+    // standard error of the mean luminance from the spread of the per-pass estimates
+    float invN = 1.f / static_cast<float>(n);
+    float mean = Luminance(accumulation.Get(index, n)) * invN;
+    float variance = glm::max(0.f, m_luminanceSquaredSums[index] * invN - mean * mean) * static_cast<float>(n) / static_cast<float>(n - 1);
+    float standardError = glm::sqrt(variance * invN);
+
+    // the threshold applies to the displayed value (after gamma), i.e. dark pixels need a smaller absolute error
+    float displayError = standardError / (2.f * glm::sqrt(glm::max(mean, 1e-4f)));
+
+    return displayError <= m_adaptiveThreshold;
+}
+
+bool Renderer::IsRefining() const
+{
+    return !m_activeTasks.empty();
+}
+
+bool Renderer::Render(const Hitable& world, uint32_t* pixelData)
+{
+    auto frameStart = std::chrono::steady_clock::now();
+    m_passGeneration = m_frameGeneration.load(std::memory_order_relaxed);
+
+    if (m_pathGuiding && !m_guidingField)
+    {
+        m_guidingField.reset(new GuidingField(world.BoundingBox()));
+    }
+
+    const Camera& camera = m_trackball.GetCamera();
+
+    glm::vec3 lowerLeft = camera.GetOrigin() + camera.GetDirection() - camera.GetRight() * m_viewport.GetHorizontalLinearFov() - camera.GetUp();
+    glm::vec3 vertical = 2.f * camera.GetUp();
+    glm::vec3 horizontal = 2.f * camera.GetRight() * m_viewport.GetHorizontalLinearFov();
+
+    // without a budget every call renders the (rest of the) pass, otherwise the tiles that fit into the remaining time
+    int numChunks = 0;
+    while (IsRefining())
     {
-        const Camera& camera = m_trackball.GetCamera();
+        double seconds = std::numeric_limits<double>::infinity();
+        if (m_frameBudget > 0.0)
+        {
+            seconds = m_frameBudget - m_resolveSeconds - std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+            if (seconds <= 0.0 && numChunks > 0)
+            {
+                break;
+            }
+        }
 
-        glm::vec3 lowerLeft = camera.GetOrigin() + camera.GetDirection() - camera.GetRight() * m_viewport.GetHorizontalLinearFov() - camera.GetUp();
-        glm::vec3 vertical = 2.f * camera.GetUp();
-        glm::vec3 horizontal = 2.f * camera.GetRight() * m_viewport.GetHorizontalLinearFov();
+        if (!m_passScheduled)
+        {
+            SchedulePass();
+        }
+
+        if (!SelectPassTiles(seconds, numChunks == 0))
+        {
+            break;
+        }
 
-        // set number of tasks the thread pool should process (in the current frame)
-        m_threadPool.SetTaskCounter(m_numRenderTasks);
+        auto chunkStart = std::chrono::steady_clock::now();
 
-        for (int t = 0; t < m_numRenderTasks - 1; ++t)
+        // tiles that are written back record their render time, so a negative time marks the ones discarded by a cancel
+        for (int t : m_chunkTasks)
         {
-            int minLine = t * NUM_LINES_PER_RENDER_TASK;
-            int maxLine = (t + 1) * NUM_LINES_PER_RENDER_TASK;
+            m_tileLastSeconds[t] = -1.f;
+        }
 
-            m_threadPool.AddTask(RenderTask{ this, minLine, maxLine, camera, world, lowerLeft, vertical, horizontal });
+        // converged tiles are not issued anymore
+        if (m_atomicTileDispatch)
+        {
+            TileBatch batch{ m_chunkTasks.data(), m_chunkOffsets.data(), [&](int t) { RenderTile(t, camera, world, lowerLeft, vertical, horizontal); } };
+            m_threadPool.RunTileBatch(batch);
+        }
+        else
+        {
+            // set number of tasks the thread pool should process (in the current frame)
+            m_threadPool.SetTaskCounter(static_cast<int>(m_chunkTasks.size()));
+
+            for (int t : m_chunkTasks)
+            {
+                m_threadPool.AddTask(RenderTask{ this, t, camera, world, lowerLeft, vertical, horizontal });
+            }
+
+            // wait for all tasks to finish
+            m_threadPool.WaitForTasks();
+        }
+
+        bool cancelled = IsPassCancelled();
+        m_passSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - chunkStart).count();
+        ++numChunks;
+
+        // cost model for the frame budget and measurements for auto-tuning
+        for (int t : m_chunkTasks)
+        {
+            float seconds = m_tileLastSeconds[t];
+            if (seconds < 0.f)
+            {
+                continue;
+            }
+
+            float& averageSeconds = m_tileSeconds[t];
+            averageSeconds = (averageSeconds > 0.f) ? averageSeconds + static_cast<float>(COST_SMOOTHING) * (seconds - averageSeconds) : seconds;
+
+            m_passBusySeconds += seconds;
+            m_passPixels += static_cast<double>(m_tiles[t].width) * static_cast<double>(m_tiles[t].height);
+            m_passSquaredError += m_tileSquaredErrors[t];
+            m_passErrorPixels += static_cast<double>(m_tileErrorPixels[t]);
+        }
+
+        // the tiles that were written back got their pass (all of them unless the pass was cancelled), they move to the
+        // front of the node's chunk and are done, the others keep their previous state and are rendered after resuming
+        bool passDone = true;
+        for (size_t n = 0; n < m_passProgress.size(); ++n)
+        {
+            auto first = m_passTasks.begin() + m_passOffsets[n] + m_passProgress[n];
+            auto last = first + (m_chunkOffsets[n + 1] - m_chunkOffsets[n]);
+            auto unfinished = std::stable_partition(first, last, [this](int t) { return m_tileLastSeconds[t] >= 0.f; });
+            m_passProgress[n] += static_cast<int>(unfinished - first);
+            passDone = passDone && (m_passOffsets[n] + m_passProgress[n] == m_passOffsets[n + 1]);
+        }
+
+        if (passDone)
+        {
+            FinishPass();
+        }
+
+        // the pixels are not resolved after a cancel (the scene or the settings are about to change)
+        if (cancelled)
+        {
+            return false;
+        }
+
+        if (m_frameBudget <= 0.0)
+        {
+            break;
         }
-        // last task can have less lines, so we handle it explicitly
-        m_threadPool.AddTask(RenderTask{ this, (m_numRenderTasks - 1) * NUM_LINES_PER_RENDER_TASK, m_viewport.GetHeight(), camera, world, lowerLeft, vertical, horizontal });
-    
-        // wait for all tasks to finish
-        m_threadPool.WaitForTasks();
-    
-        m_currentRefinementIteration++;
     }
 
+    auto resolveStart = std::chrono::steady_clock::now();
     SetAccumulatedImage(pixelData);
+
+    double resolveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - resolveStart).count();
+    m_resolveSeconds = (m_resolveSeconds > 0.0) ? m_resolveSeconds + COST_SMOOTHING * (resolveSeconds - m_resolveSeconds) : resolveSeconds;
+    return true;
 }
 
-void Renderer::SetAccumulatedImage(uint32_t* pixelData)
+void Renderer::SchedulePass()
+{
+    const int numNodes = m_threadPool.GetNumNodes();
+
+    // distance of the tile centers from the focus point in units of the fovea radius
+    std::vector<float> focusDistances;
+    bool foveaRefining = false;
+    if (m_foveation)
+    {
+        glm::vec2 focus(GetFocusPoint());
+        float radius = FOVEA_RADIUS * glm::length(glm::vec2(m_viewport.GetWidth(), m_viewport.GetHeight()));
+
+        focusDistances.resize(m_tiles.size());
+        for (int t : m_activeTasks)
+        {
+            const Tile& tile = m_tiles[t];
+            glm::vec2 center(static_cast<float>(tile.x) + 0.5f * tile.width, static_cast<float>(tile.y) + 0.5f * tile.height);
+            focusDistances[t] = glm::length(center - focus) / radius;
+            foveaRefining = foveaRefining || (focusDistances[t] <= 1.f);
+        }
+    }
+
+    // a tile at 2^k fovea radii gets every 2^k-th pass, i.e. it is due once the passes so far are enough for its next one
+    auto isDue = [&](int t)
+        {
+            if (!foveaRefining || focusDistances[t] <= 1.f)
+            {
+                return true;
+            }
+            int level = glm::min(static_cast<int>(glm::ceil(glm::log2(focusDistances[t]))), MAX_FOVEATION_LEVEL);
+            return (static_cast<int64_t>(m_tilePasses[t]) << level) <= m_currentRefinementIteration;
+        };
+
+    m_passTasks.clear();
+    m_passOffsets.assign(numNodes + 1, 0);
+    for (int n = 0; n < numNodes; ++n)
+    {
+        for (int i = m_nodeOffsets[n]; i < m_nodeOffsets[n + 1]; ++i)
+        {
+            if (isDue(m_activeTasks[i]))
+            {
+                m_passTasks.push_back(m_activeTasks[i]);
+            }
+        }
+
+        // the tiles closest to the focus are rendered (and shown) first
+        if (m_foveation)
+        {
+            std::stable_sort(m_passTasks.begin() + m_passOffsets[n], m_passTasks.end(), [&](int a, int b) { return focusDistances[a] < focusDistances[b]; });
+        }
+        m_passOffsets[n + 1] = static_cast<int>(m_passTasks.size());
+    }
+
+    m_passProgress.assign(numNodes, 0);
+    m_passScheduled = true;
+}
+
+/// Puts the next tiles of the current pass that are predicted to take at most the given time into m_chunkTasks,
+/// returns false if there are none (force: at least one tile per thread, even if they take longer)
+bool Renderer::SelectPassTiles(double seconds, bool force)
+{
+    const int numNodes = m_threadPool.GetNumNodes();
+    const int numThreads = static_cast<int>(m_threadPool.GetNumActiveThreads());
+
+    // tiles that have not been rendered yet are assumed to take as long as the average of the measured ones
+    double measuredSeconds = 0.0;
+    int numMeasured = 0;
+    for (int t : m_activeTasks)
+    {
+        if (m_tileSeconds[t] > 0.f)
+        {
+            measuredSeconds += m_tileSeconds[t];
+            ++numMeasured;
+        }
+    }
+    double unknownSeconds = (numMeasured > 0) ? measuredSeconds / numMeasured : std::numeric_limits<double>::infinity();
+
+    // take the next tiles of the nodes in turns (so that all nodes get work), at least one per thread to keep them busy
+    std::vector<int> counts(numNodes, 0);
+    int numTiles = 0;
+    double predictedSeconds = 0.0;
+    bool full = false;
+    for (bool added = true; added && !full; )
+    {
+        added = false;
+        for (int n = 0; n < numNodes && !full; ++n)
+        {
+            int next = m_passOffsets[n] + m_passProgress[n] + counts[n];
+            if (next == m_passOffsets[n + 1])
+            {
+                continue;
+            }
+
+            float tileSeconds = m_tileSeconds[m_passTasks[next]];
+            double cost = ((tileSeconds > 0.f) ? tileSeconds : unknownSeconds) / numThreads;
+            if (predictedSeconds + cost > seconds && numTiles >= numThreads)
+            {
+                full = true;
+                break;
+            }
+
+            predictedSeconds += cost;
+            counts[n]++;
+            numTiles++;
+            added = true;
+        }
+    }
+
+    // the first chunk of a frame is rendered in any case, later ones only if they are predicted to fit
+    if (numTiles == 0 || (!force && predictedSeconds > seconds))
+    {
+        return false;
+    }
+
+    m_chunkTasks.clear();
+    m_chunkOffsets.assign(numNodes + 1, 0);
+    for (int n = 0; n < numNodes; ++n)
+    {
+        auto first = m_passTasks.begin() + m_passOffsets[n] + m_passProgress[n];
+        m_chunkTasks.insert(m_chunkTasks.end(), first, first + counts[n]);
+        m_chunkOffsets[n + 1] = m_chunkOffsets[n] + counts[n];
+    }
+    return true;
+}
+
+void Renderer::FinishPass()
+{
+    m_currentRefinementIteration++;
+    double passSeconds = m_passSeconds;
+    double passBusySeconds = m_passBusySeconds;
+    double passPixels = m_passPixels;
+    double passSquaredError = m_passSquaredError;
+    double passErrorPixels = m_passErrorPixels;
+
+    // tiles leave the schedule once they got the maximum number of passes or all of their pixels are converged
+    auto tileDone = [&](int t) { return m_tilePasses[t] >= static_cast<uint32_t>(NUM_MAX_REFINEMENTS) || (m_adaptiveThreshold > 0.f && m_tileConverged[t] != 0); };
+    m_activeTasks.erase(std::remove_if(m_activeTasks.begin(), m_activeTasks.end(), tileDone), m_activeTasks.end());
+    UpdateNodeOffsets();
+
+    // progressive training: iterations of 1, 2, 4, ... passes
+    if (m_pathGuiding && m_guidingField->GetIteration() < MAX_GUIDING_ITERATIONS && ++m_guidingPasses >= (1 << m_guidingField->GetIteration()))
+    {
+        m_guidingField->EndIteration();
+        m_guidingPasses = 0;
+    }
+
+    if (m_logStatistics)
+    {
+        LogPassStatistics(passSeconds, passSquaredError, passErrorPixels);
+    }
+
+    // the next candidate (or the final configuration) applies from the next pass
+    if (m_autoTuning && !m_autoTuner.IsDone() && m_autoTuner.AddPass(passSeconds, passBusySeconds, passPixels))
+    {
+        ApplyTuning();
+    }
+}
+
+void Renderer::LogPassStatistics(double passSeconds, double passSquaredError, double passErrorPixels)
 {
-    float invRefinements = 1.f / static_cast<float>(m_currentRefinementIteration);
+    int n = m_currentRefinementIteration;
+    m_statisticsSeconds += passSeconds;
 
-    for (size_t index = 0; index < m_accumulationBuffer.size(); ++index)
+    // only the pixels traced in this pass count (converged tiles and tiles that were not due are skipped), the errors are
+    // already scaled to the variance per pass
+    if (passErrorPixels > 0.0)
     {
-        glm::vec3 color = m_accumulationBuffer[index] * invRefinements;
-    
-        uint8_t rc = static_cast<uint8_t>(color.r * 255.f);
-        uint8_t gc = static_cast<uint8_t>(color.g * 255.f);
-        uint8_t bc = static_cast<uint8_t>(color.b * 255.f);
+        m_statisticsVarianceSum += passSquaredError / passErrorPixels;
+        ++m_statisticsVariancePasses;
+    }
 
-        uint32_t pixel = 0xFF << 24;  // full alpha
-        pixel |= (static_cast<uint32_t>(rc) << 0);
-        pixel |= (static_cast<uint32_t>(gc) << 8);
-        pixel |= (static_cast<uint32_t>(bc) << 16);
+    // report averages at powers of two
+    if ((n & (n - 1)) != 0 || m_statisticsVariancePasses == 0)
+    {
+        return;
+    }
+
+    double variance = m_statisticsVarianceSum / static_cast<double>(m_statisticsVariancePasses);
+    double secondsPerPass = m_statisticsSeconds / static_cast<double>(n);
+
+    SDL_Log("pass %4d: %7.1f ms/pass, per-pass variance %.3g, efficiency 1/(variance * time) %.4g%s",
+        n, 1000.0 * secondsPerPass, variance, 1.0 / (variance * secondsPerPass),
+        m_pathGuiding ? " (path guiding)" : "");
 
-        pixelData[index] = pixel;
+    if (m_adaptiveThreshold > 0.f)
+    {
+        uint64_t totalPasses = 0;
+        for (uint32_t passes : m_pixelPasses)
+        {
+            totalPasses += passes;
+        }
+        SDL_Log("           adaptive sampling: %.1f%% of the samples of uniform sampling, %d of %d tiles active",
+            100.0 * static_cast<double>(totalPasses) / (static_cast<double>(n) * static_cast<double>(m_viewport.GetWidth()) * static_cast<double>(m_viewport.GetHeight())),
+            static_cast<int>(m_activeTasks.size()), static_cast<int>(m_tiles.size()));
     }
 }
 
-void Renderer::RenderLines(int min, int max, const Camera& camera, const Hitable& world, glm::vec3 lowerLeft, glm::vec3 vertical, glm::vec3 horizontal)
+void Renderer::SetAccumulatedImage(uint32_t* pixelData)
 {
-    for (int j = max - 1; j >= min; --j)
+    // versions of the tiles in this buffer (most recently used buffer first, a new one has no tiles yet)
+    auto buffer = std::find_if(m_resolvedBuffers.begin(), m_resolvedBuffers.end(), [&](const ResolvedBuffer& b) { return b.pixels == pixelData; });
+    if (buffer == m_resolvedBuffers.end())
+    {
+        if (m_resolvedBuffers.size() == MAX_RESOLVED_BUFFERS)
+        {
+            m_resolvedBuffers.pop_back();
+        }
+        m_resolvedBuffers.push_back(ResolvedBuffer{ pixelData, std::vector<uint32_t>(m_tiles.size(), 0u) });
+        buffer = m_resolvedBuffers.end() - 1;
+    }
+    std::rotate(m_resolvedBuffers.begin(), buffer, buffer + 1);
+    std::vector<uint32_t>& resolvedVersions = m_resolvedBuffers.front().tileVersions;
+
+    // only tiles whose accumulation changed since they were resolved into this buffer (marked in a grid of the tiles)
+    int tilesX = (m_viewport.GetWidth() + m_tileSize - 1) / m_tileSize;
+    m_resolveTiles.assign(m_tiles.size(), 0);
+    bool changed = false;
+    for (size_t t = 0; t < m_tiles.size(); ++t)
     {
+        if (resolvedVersions[t] != m_tileVersions[t])
+        {
+            m_resolveTiles[(m_tiles[t].y / m_tileSize) * tilesX + m_tiles[t].x / m_tileSize] = 1;
+            resolvedVersions[t] = m_tileVersions[t];
+            changed = true;
+        }
+    }
+    if (!changed)
+    {
+        return;
+    }
+
+    // rows are resolved in runs of adjacent changed tiles (whole rows if everything changed), which keeps the memory accesses sequential
+    m_threadPool.ParallelFor(0, m_viewport.GetHeight(), [&](int row)
+        {
+            const uint8_t* rowTiles = &m_resolveTiles[(row / m_tileSize) * tilesX];
+            for (int tx = 0; tx < tilesX; )
+            {
+                if (!rowTiles[tx])
+                {
+                    ++tx;
+                    continue;
+                }
+
+                int first = tx;
+                while (tx < tilesX && rowTiles[tx])
+                {
+                    ++tx;
+                }
+
+                int x = first * m_tileSize;
+                int width = glm::min(tx * m_tileSize, m_viewport.GetWidth()) - x;
+                size_t index = static_cast<size_t>(row) * m_rowStride + x;
+                m_accumulationBuffer->Resolve(index, &m_pixelPasses[index], pixelData + row * m_viewport.GetWidth() + x, width, m_pixelFormat);
+            }
+        }, RESOLVE_ROWS_PER_CHUNK);
+}
+
+template <typename Storage>
+void Renderer::RenderTile(Storage& accumulation, int tileIndex, const Camera& camera, const Hitable& world, glm::vec3 lowerLeft, glm::vec3 vertical, glm::vec3 horizontal)
+{
+    if (IsPassCancelled())
+    {
+        return;
+    }
+
+    auto tileStart = std::chrono::steady_clock::now();
+    const Tile& tile = m_tiles[tileIndex];
+
+    // the sampler belongs to the render thread as well and is only created again when the sampler type changes (every
+    // pixel sample starts from its pixel and sample index, so nothing carries over from the previous tile)
+    static thread_local std::unique_ptr<Sampler> sampler;
+    static thread_local SamplerType samplerType = SamplerType::Count;
+    if (samplerType != m_samplerType)
+    {
+        sampler = CreateSampler(m_samplerType);
+        samplerType = m_samplerType;
+    }
+
+    // the colors of this pass are kept local to the tile and written back row by row afterwards,
+    // so the shared buffers are not touched while the paths are traced. The buffers belong to the render thread and only
+    // grow to the largest tile it rendered, so tiles do not allocate.
+    static thread_local std::vector<glm::vec3> passColors;
+    static thread_local std::vector<uint8_t> traced;
+    size_t tilePixels = static_cast<size_t>(tile.width) * tile.height;
+    if (passColors.size() < tilePixels)
+    {
+        passColors.resize(tilePixels);
+    }
+    traced.assign(tilePixels, 0);
+
+    for (int row = tile.y; row < tile.y + tile.height; ++row)
+    {
+        // a cancelled tile discards its samples (nothing has been written back yet)
+        if (IsPassCancelled())
+        {
+            return;
+        }
+
         // note that pixels start at upper left in SDL2 buffer
-        int lineOffset = (m_viewport.GetHeight() - 1 - j)*m_viewport.GetWidth();
+        int j = m_viewport.GetHeight() - 1 - row;
+        size_t rowOffset = static_cast<size_t>(row) * m_rowStride;
 
-        for (int i = 0; i < m_viewport.GetWidth(); ++i)
+        for (int i = tile.x; i < tile.x + tile.width; ++i)
         {
+            size_t index = rowOffset + i;
+            if (IsPixelConverged(accumulation, index))
+            {
+                continue;
+            }
+
             glm::vec2 pixelCoord(static_cast<float>(i), static_cast<float>(j));
 
             glm::vec3 color = glm::vec3(0.f);
 
-            for (auto& subpixelOffset : ms_samples)
+            uint32_t passes = m_pixelPasses[index];
+            for (int s = 0; s < SAMPLES_PER_PASS; ++s)
             {
-                glm::vec2 sampleCoord = pixelCoord + subpixelOffset;
+                // sample indices continue over refinement iterations and only depend on the pixel, not on the thread
+                sampler->StartPixelSample(i, j, passes * SAMPLES_PER_PASS + static_cast<uint32_t>(s));
+
+                glm::vec2 sampleCoord = pixelCoord + sampler->Get2D();
                 sampleCoord *= m_viewport.GetViewportSizeRcp();
 
-                Ray r(camera.GetOrigin(), glm::normalize(lowerLeft + sampleCoord.x * horizontal + sampleCoord.y * vertical - camera.GetOrigin()));
+                glm::vec3 target = lowerLeft + sampleCoord.x * horizontal + sampleCoord.y * vertical - camera.GetOrigin();
+                Ray r(camera.GetOrigin(), glm::normalize(target));
+
+                // differentials for the neighboring pixels (used to select the texture mip level)
+                glm::vec3 dx = horizontal * m_viewport.GetViewportSizeRcp().x;
+                glm::vec3 dy = vertical * m_viewport.GetViewportSizeRcp().y;
+                r.SetDifferentials(camera.GetOrigin(), glm::normalize(target + dx), camera.GetOrigin(), glm::normalize(target + dy));
+
+                color += ComputeColor(r, world, *sampler);
+            }
+
+            int local = (row - tile.y) * tile.width + (i - tile.x);
+            passColors[local] = color * (1.f / static_cast<float>(SAMPLES_PER_PASS));
+            traced[local] = 1;
+        }
+    }
+
+    // deviation of this pass from the mean of the previous passes (for estimating the variance per pass)
+    double squaredError = 0.0;
+    int errorPixels = 0;
+    bool tileConverged = true;
 
-                color += ComputeColor(r, world);
+    for (int row = tile.y; row < tile.y + tile.height; ++row)
+    {
+        size_t rowOffset = static_cast<size_t>(row) * m_rowStride;
+        for (int i = tile.x; i < tile.x + tile.width; ++i)
+        {
+            int local = (row - tile.y) * tile.width + (i - tile.x);
+            if (!traced[local])
+            {
+                continue;
             }
 
-            color *= ms_weightingFactor;
+            size_t index = rowOffset + i;
+            const glm::vec3& color = passColors[local];
+            uint32_t passes = m_pixelPasses[index];
+
+            // the squared difference between a pass and the mean of the previous passes has the expectation
+            // variance * (passes + 1) / passes
+            if (passes > 0)
+            {
+                glm::vec3 deviation = color - accumulation.Get(index, passes) * (1.f / static_cast<float>(passes));
+                squaredError += glm::dot(deviation, deviation) / 3.f * static_cast<float>(passes) / static_cast<float>(passes + 1);
+                ++errorPixels;
+            }
 
-            GammaCorrection(color);
- 
-            int index = lineOffset + i;
+            float luminance = Luminance(color);
+            accumulation.Add(index, passes, color);
+            m_luminanceSquaredSums[index] += luminance * luminance;
+            m_pixelPasses[index] = passes + 1;
 
-            m_accumulationBuffer[index] += color;
+            tileConverged = tileConverged && IsPixelConverged(accumulation, index);
         }
     }
+
+    m_tileSquaredErrors[tileIndex] = squaredError;
+    m_tileErrorPixels[tileIndex] = errorPixels;
+    m_tileConverged[tileIndex] = tileConverged ? 1 : 0;
+    m_tilePasses[tileIndex]++;
+
+    // the resolve skips tiles whose pixels did not change (e.g. because all of them are converged)
+    if (std::find(traced.begin(), traced.end(), static_cast<uint8_t>(1)) != traced.end())
+    {
+        m_tileVersions[tileIndex]++;
+    }
+
+    m_tileLastSeconds[tileIndex] = std::chrono::duration<float>(std::chrono::steady_clock::now() - tileStart).count();
+}
+
+void Renderer::RenderTile(int tileIndex, const Camera& camera, const Hitable& world, glm::vec3 lowerLeft, glm::vec3 vertical, glm::vec3 horizontal)
+{
+    // the format is dispatched once per tile instead of once per pixel access
+    switch (m_accumulationBuffer->GetFormat())
+    {
+    case AccumulationFormat::Half:
+        RenderTile(GetStorage<HalfMeans>(*m_accumulationBuffer), tileIndex, camera, world, lowerLeft, vertical, horizontal);
+        break;
+    case AccumulationFormat::Double:
+        RenderTile(GetStorage<DoubleSums>(*m_accumulationBuffer), tileIndex, camera, world, lowerLeft, vertical, horizontal);
+        break;
+    case AccumulationFormat::Kahan:
+        RenderTile(GetStorage<KahanSums>(*m_accumulationBuffer), tileIndex, camera, world, lowerLeft, vertical, horizontal);
+        break;
+    case AccumulationFormat::Planar:
+        RenderTile(GetStorage<PlanarSums>(*m_accumulationBuffer), tileIndex, camera, world, lowerLeft, vertical, horizontal);
+        break;
+    case AccumulationFormat::Float:
+    default:
+        RenderTile(GetStorage<FloatSums>(*m_accumulationBuffer), tileIndex, camera, world, lowerLeft, vertical, horizontal);
+        break;
+    }
 }
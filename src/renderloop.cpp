@@ -0,0 +1,129 @@
+#include "renderloop.h"
+
+#include <chrono>
+
+// interval in which Pause() repeats the cancellation (a pass may have started just before the first one)
+constexpr std::chrono::milliseconds CANCEL_INTERVAL(1);
+
+RenderLoop::RenderLoop(Renderer& renderer, const Hitable& world)
+: m_renderer(renderer)
+, m_world(world)
+, m_paused(false)
+, m_suspended(false)
+, m_rendering(false)
+, m_clearFramebuffer(true)
+, m_stopThread(false)
+{
+    size_t numPixels = static_cast<size_t>(renderer.GetViewport().GetWidth()) * static_cast<size_t>(renderer.GetViewport().GetHeight());
+    for (int i = 0; i < 3; ++i)
+    {
+        m_frames.GetBuffer(i).resize(numPixels, 0u);
+    }
+
+    m_thread = std::thread{ [this]() { ThreadLoop(); } };
+}
+
+RenderLoop::~RenderLoop()
+{
+    Pause();
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_stopThread = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void RenderLoop::Pause()
+{
+    std::unique_lock<std::mutex> lck(m_mutex);
+    m_paused = true;
+    while (m_rendering)
+    {
+        m_renderer.CancelFrame();
+        m_condition.wait_for(lck, CANCEL_INTERVAL);
+    }
+}
+
+void RenderLoop::SetSuspended(bool suspended)
+{
+    {
+        std::unique_lock<std::mutex> lck(m_mutex);
+        m_suspended = suspended;
+
+        // the tiles of a cancelled pass are rendered again after resuming
+        while (suspended && m_rendering)
+        {
+            m_renderer.CancelFrame();
+            m_condition.wait_for(lck, CANCEL_INTERVAL);
+        }
+    }
+    m_condition.notify_all();
+}
+
+bool RenderLoop::IsIdle()
+{
+    // a frame is published before m_rendering is reset, so it is seen here if the thread is idle
+    std::lock_guard<std::mutex> lck(m_mutex);
+    return !m_rendering && !HasWork() && !m_frames.HasNewFrame();
+}
+
+bool RenderLoop::HasWork() const
+{
+    // once the image is final, the thread sleeps until the settings change
+    return !m_paused && !m_suspended && (m_clearFramebuffer || m_renderer.IsRefining());
+}
+
+void RenderLoop::Resume(bool clearFramebuffer)
+{
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        if (clearFramebuffer)
+        {
+            // the render thread is idle, so the consumer side may drop a frame of the previous settings
+            m_clearFramebuffer = true;
+            m_frames.Update();
+        }
+        m_paused = false;
+    }
+    m_condition.notify_all();
+}
+
+const uint32_t* RenderLoop::AcquireFrame()
+{
+    return m_frames.Update() ? m_frames.GetFrontBuffer().data() : nullptr;
+}
+
+void RenderLoop::ThreadLoop()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lck(m_mutex);
+            m_condition.wait(lck, [this]() { return HasWork() || m_stopThread; });
+            if (m_stopThread)
+            {
+                return;
+            }
+
+            m_rendering = true;
+            if (m_clearFramebuffer)
+            {
+                m_renderer.ClearFramebuffer();
+                m_clearFramebuffer = false;
+            }
+        }
+
+        // the pixels are only written if the pass was completed
+        if (m_renderer.Render(m_world, m_frames.GetBackBuffer().data()))
+        {
+            m_frames.Publish();
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(m_mutex);
+            m_rendering = false;
+        }
+        m_condition.notify_all();
+    }
+}
@@ -1,65 +1,399 @@
 #include "renderthreadpool.h"
 
+#include "cputopology.h"
 #include "renderer.h"
 
-void RenderTask::operator()() { 
-    renderer->RenderLines(minLine, maxLine, camera, world, lowerLeft, vertical, horizontal);
+// number of unsuccessful attempts to find work before an idle thread parks (and before WaitForTasks() blocks)
+constexpr int IDLE_SPIN_ROUNDS = 64;
+
+namespace
+{
+    // pool the current thread works for: always for workers, during a batch for the submitting thread
+    // (batches submitted from inside another batch run serially)
+    thread_local const RenderThreadPool* t_currentPool = nullptr;
+}
+
+void RenderTask::operator()() {
+    renderer->RenderTile(tileIndex, camera, world, lowerLeft, vertical, horizontal);
 }
 
-RenderThreadPool::RenderThreadPool(int numThreads) : m_taskCounter(0), m_stopThreads(false)
+RenderThreadPool::RenderThreadPool(int numThreads, bool topologyAware)
+: m_numInjected(0)
+, m_workEpoch(0)
+, m_numParked(0)
+, m_numNodes(1)
+, m_tileBatch(nullptr)
+, m_frameEpoch(0)
+, m_numWorkersInFrame(0)
+, m_taskCounter(0)
+, m_numActiveWorkers(0)
+, m_stopThreads(false)
 {
-    numThreads = std::max(numThreads, 1);
+    // the submitting thread is one of the render threads
+    numThreads = std::max(numThreads - 1, 0);
 
-    for (int i = 0; i < numThreads; ++i)
-        m_threads.push_back(std::thread{
-            /* lambda function for thread pool loop */
-            [&]() {
-                std::unique_lock<std::mutex> tLck(m_taskCounterMutex, std::defer_lock);
-                std::unique_lock<std::mutex> qLck(m_queueMutex, std::defer_lock);
-                while (true) {
-                    // wait for new task or stop signal
-                    qLck.lock();
-                    m_queueCondition.wait(qLck, [&]() {return (!m_taskQueue.empty() || m_stopThreads); });
-                    if (m_stopThreads)
-                    {
-                        qLck.unlock();
-                        break;
-                    }
-                    auto t = m_taskQueue.front();
-                    m_taskQueue.pop();
-                    qLck.unlock();
-                    // compute task
-                    t();
-                    // decrease task counter after finishing task computation and notify waiting threads
-                    tLck.lock();
-                    m_taskCounter--;
-                    tLck.unlock();
-                    m_taskCounterCondition.notify_all();
-                }
-            }
+    // worker i runs on node i % number of nodes, so the workers are spread evenly
+    m_workerNodes.assign(numThreads, 0);
+    m_workerCpus.assign(numThreads, -1);
+    if (topologyAware)
+    {
+        CpuTopology topology = CpuTopology::Detect();
+        m_numNodes = std::max(std::min(topology.GetNumNodes(), numThreads), 1);
+        for (int i = 0; i < numThreads; ++i)
+        {
+            const std::vector<int>& cpus = topology.GetNodeCpus(i % m_numNodes);
+            m_workerNodes[i] = i % m_numNodes;
+            m_workerCpus[i] = cpus[(i / m_numNodes) % cpus.size()];
         }
-    );
+    }
+    m_nextTiles.reset(new NodeCounter[m_numNodes]);
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        m_deques.push_back(std::unique_ptr<WorkStealingDeque<RenderTask>>(new WorkStealingDeque<RenderTask>()));
+    }
+
+    m_numActiveWorkers.store(numThreads, std::memory_order_relaxed);
+
+    // all deques have to exist before the first thread starts stealing
+    for (int i = 0; i < numThreads; ++i)
+    {
+        m_threads.push_back(std::thread{ [this, i]() { WorkerLoop(i); } });
+    }
 }
 
 RenderThreadPool::~RenderThreadPool()
 {
     // set stop condition variable and join threads
-    m_stopThreads = true;
-    m_queueCondition.notify_all();
+    m_stopThreads.store(true);
+    m_workEpoch.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lck(m_parkMutex);
+    }
+    m_parkCondition.notify_all();
+
     for (auto& t : m_threads)
         t.join();
+
+    // tasks that were never executed
+    for (RenderTask* task : m_injectionQueue)
+    {
+        delete task;
+    }
+    for (auto& deque : m_deques)
+    {
+        while (RenderTask* task = deque->Pop())
+        {
+            delete task;
+        }
+    }
+}
+
+void RenderThreadPool::WorkerLoop(int threadIndex)
+{
+    t_currentPool = this;
+
+    if (m_workerCpus[threadIndex] >= 0 && !PinCurrentThread(m_workerCpus[threadIndex]))
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Could not pin render thread %d to CPU %d", threadIndex, m_workerCpus[threadIndex]);
+    }
+
+    // for choosing the threads to steal from
+    Pcg32 rng(MixBits(static_cast<uint64_t>(threadIndex)), static_cast<uint64_t>(threadIndex));
+
+    uint64_t frameEpoch = 0;
+
+    while (true)
+    {
+        // read the epoch before looking for work, so work that arrives afterwards prevents parking
+        uint64_t epoch = m_workEpoch.load();
+
+        RenderTask* task = nullptr;
+        bool newFrame = false;
+        for (int spin = 0; spin < IDLE_SPIN_ROUNDS && task == nullptr && !newFrame; ++spin)
+        {
+            if (m_stopThreads.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+
+            newFrame = (m_frameEpoch.load() != frameEpoch);
+            if (!newFrame && threadIndex < m_numActiveWorkers.load(std::memory_order_relaxed))
+            {
+                task = FindTask(threadIndex, rng);
+                if (task == nullptr)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        if (newFrame)
+        {
+            ++frameEpoch;
+            RenderTileBatch(threadIndex);
+            continue;
+        }
+
+        if (task != nullptr)
+        {
+            RunTask(task);
+            continue;
+        }
+
+        // park until new work arrives
+        std::unique_lock<std::mutex> lck(m_parkMutex);
+        m_numParked.fetch_add(1);
+        m_parkCondition.wait(lck, [&]() { return m_workEpoch.load() != epoch || m_stopThreads.load(); });
+        m_numParked.fetch_sub(1);
+    }
+}
+
+RenderTask* RenderThreadPool::FindTask(int threadIndex, Pcg32& rng)
+{
+    RenderTask* task = m_deques[threadIndex]->Pop();
+    if (task != nullptr)
+    {
+        return task;
+    }
+
+    int numThreads = static_cast<int>(m_deques.size());
+    for (int attempt = 1; attempt < numThreads; ++attempt)
+    {
+        int victim = static_cast<int>(rng.NextUInt() % static_cast<uint32_t>(numThreads));
+        if (victim != threadIndex)
+        {
+            task = m_deques[victim]->Steal();
+            if (task != nullptr)
+            {
+                return task;
+            }
+        }
+    }
+
+    if (m_numInjected.load(std::memory_order_acquire) > 0)
+    {
+        std::lock_guard<std::mutex> lck(m_injectionMutex);
+        if (!m_injectionQueue.empty())
+        {
+            // take a fair share of the injected tasks, the ones that are not executed right away can be stolen
+            size_t batch = std::max<size_t>(1, m_injectionQueue.size() / m_deques.size());
+            m_numInjected.fetch_sub(static_cast<int>(batch), std::memory_order_relaxed);
+
+            task = m_injectionQueue.front();
+            m_injectionQueue.pop_front();
+            for (size_t i = 1; i < batch; ++i)
+            {
+                m_deques[threadIndex]->Push(m_injectionQueue.front());
+                m_injectionQueue.pop_front();
+            }
+        }
+    }
+
+    return task;
+}
+
+RenderTask* RenderThreadPool::FindTaskForCaller(Pcg32& rng)
+{
+    if (m_numInjected.load(std::memory_order_acquire) > 0)
+    {
+        std::lock_guard<std::mutex> lck(m_injectionMutex);
+        if (!m_injectionQueue.empty())
+        {
+            m_numInjected.fetch_sub(1, std::memory_order_relaxed);
+            RenderTask* task = m_injectionQueue.front();
+            m_injectionQueue.pop_front();
+            return task;
+        }
+    }
+
+    int numThreads = static_cast<int>(m_deques.size());
+    for (int attempt = 0; attempt < numThreads; ++attempt)
+    {
+        RenderTask* task = m_deques[rng.NextUInt() % static_cast<uint32_t>(numThreads)]->Steal();
+        if (task != nullptr)
+        {
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void RenderThreadPool::RunTask(RenderTask* task)
+{
+    // compute task
+    (*task)();
+    delete task;
+
+    // the thread that finishes the last task wakes the waiting thread
+    if (m_taskCounter.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        {
+            std::lock_guard<std::mutex> lck(m_taskCounterMutex);
+        }
+        m_taskCounterCondition.notify_all();
+    }
+}
+
+void RenderThreadPool::SetNumActiveThreads(int numThreads)
+{
+    m_numActiveWorkers.store(std::max(std::min(numThreads - 1, static_cast<int>(m_threads.size())), 0), std::memory_order_relaxed);
 }
 
 void RenderThreadPool::AddTask(RenderTask t)
 {
-    std::lock_guard<std::mutex> lck(m_queueMutex);
-    m_taskQueue.push(t);
-    m_queueCondition.notify_one();
+    {
+        std::lock_guard<std::mutex> lck(m_injectionMutex);
+        m_injectionQueue.push_back(new RenderTask(t));
+    }
+    m_numInjected.fetch_add(1, std::memory_order_release);
+
+    // a thread that is about to park either sees the new epoch or is counted as parked (and then notified)
+    m_workEpoch.fetch_add(1);
+    if (m_numParked.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lck(m_parkMutex);
+        }
+        m_parkCondition.notify_one();
+    }
 }
 
-void RenderThreadPool::WaitForTasks()
+template <typename Predicate>
+void RenderThreadPool::WaitUntil(Predicate done)
 {
+    for (int spin = 0; spin < IDLE_SPIN_ROUNDS; ++spin)
+    {
+        if (done())
+        {
+            return;
+        }
+        std::this_thread::yield();
+    }
+
     std::unique_lock<std::mutex> lck(m_taskCounterMutex);
-    m_taskCounterCondition.wait(lck, [&]() {return (m_taskCounter == 0); });
+    m_taskCounterCondition.wait(lck, done);
     lck.unlock();
 }
+
+void RenderThreadPool::WaitForTasks()
+{
+    // help instead of idling (tasks that are already running on workers are waited for below)
+    Pcg32 rng;
+    while (RenderTask* task = FindTaskForCaller(rng))
+    {
+        RunTask(task);
+    }
+
+    WaitUntil([this]() { return (m_taskCounter.load(std::memory_order_acquire) == 0); });
+}
+
+void RenderThreadPool::RunTileBatch(const TileBatch& batch)
+{
+    if (t_currentPool == this)
+    {
+        // the workers may be busy with the outer batch, which would never finish if they had to check in here
+        for (int i = 0; i < batch.nodeOffsets[m_numNodes]; ++i)
+        {
+            batch.function(batch.tiles != nullptr ? batch.tiles[i] : i);
+        }
+        return;
+    }
+
+    if (batch.nodeOffsets[m_numNodes] == 0)
+    {
+        return;
+    }
+
+    // all workers have left the previous batch, so nobody touches the batch or the counters while they are replaced
+    m_tileBatch = &batch;
+    for (int node = 0; node < m_numNodes; ++node)
+    {
+        m_nextTiles[node].nextTile.store(0, std::memory_order_relaxed);
+    }
+    m_numWorkersInFrame.store(static_cast<int>(m_threads.size()), std::memory_order_relaxed);
+    m_frameEpoch.fetch_add(1);
+
+    // wake all parked workers, every worker has to check in at the barrier
+    m_workEpoch.fetch_add(1);
+    if (m_numParked.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lck(m_parkMutex);
+        }
+        m_parkCondition.notify_all();
+    }
+
+    // the calling thread renders as well and then waits for the workers that are still busy
+    t_currentPool = this;
+    RunTiles(0);
+    WaitUntil([this]() { return (m_numWorkersInFrame.load(std::memory_order_acquire) == 0); });
+    t_currentPool = nullptr;
+    m_tileBatch = nullptr;
+}
+
+void RenderThreadPool::ParallelFor(int begin, int end, const std::function<void(int)>& function, int grainSize)
+{
+    if (end <= begin)
+    {
+        return;
+    }
+
+    // the chunks are distributed evenly over the nodes
+    grainSize = std::max(grainSize, 1);
+    int numChunks = (end - begin + grainSize - 1) / grainSize;
+    std::vector<int> nodeOffsets(m_numNodes + 1);
+    for (int node = 0; node <= m_numNodes; ++node)
+    {
+        nodeOffsets[node] = static_cast<int>(static_cast<int64_t>(numChunks) * node / m_numNodes);
+    }
+
+    TileBatch batch{ nullptr, nodeOffsets.data(), [&](int chunk)
+        {
+            int first = begin + chunk * grainSize;
+            int last = std::min(first + grainSize, end);
+            for (int i = first; i < last; ++i)
+            {
+                function(i);
+            }
+        } };
+    RunTileBatch(batch);
+}
+
+void RenderThreadPool::RunTiles(int homeNode)
+{
+    const TileBatch& batch = *m_tileBatch;
+
+    // tiles of the home node first (their memory is local), then help the other nodes
+    for (int n = 0; n < m_numNodes; ++n)
+    {
+        int node = (homeNode + n) % m_numNodes;
+        std::atomic<int>& nextTile = m_nextTiles[node].nextTile;
+        int offset = batch.nodeOffsets[node];
+        int numTiles = batch.nodeOffsets[node + 1] - offset;
+
+        for (int i = nextTile.fetch_add(1, std::memory_order_relaxed); i < numTiles; i = nextTile.fetch_add(1, std::memory_order_relaxed))
+        {
+            batch.function(batch.tiles != nullptr ? batch.tiles[offset + i] : offset + i);
+        }
+    }
+}
+
+void RenderThreadPool::RenderTileBatch(int threadIndex)
+{
+    // inactive workers only check in
+    if (threadIndex < m_numActiveWorkers.load(std::memory_order_relaxed))
+    {
+        RunTiles(m_workerNodes[threadIndex]);
+    }
+
+    // the last worker to check in releases the thread that waits for the batch
+    if (m_numWorkersInFrame.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        {
+            std::lock_guard<std::mutex> lck(m_taskCounterMutex);
+        }
+        m_taskCounterCondition.notify_all();
+    }
+}
@@ -0,0 +1,313 @@
+#include "sampler.h"
+
+#include <vector>
+
+namespace
+{
+    // 0.32 fixed point increments of the low-discrepancy recurrences, so sample indices never lose precision
+    constexpr uint32_t GOLDEN_RATIO_INCREMENT = 2654435769u;   ///< 2^32 / golden ratio
+    constexpr uint32_t R2_INCREMENT_X = 3242174889u;           ///< 2^32 / plastic number
+    constexpr uint32_t R2_INCREMENT_Y = 2447445414u;           ///< 2^32 / plastic number^2
+
+    // side length of the blue-noise mask (a power of two)
+    constexpr int BLUE_NOISE_SIZE_LOG2 = 6;
+    constexpr int BLUE_NOISE_SIZE = 1 << BLUE_NOISE_SIZE_LOG2;
+
+    /// Maps the upper 24 bits of x to [0, 1)
+    float ToFloat(uint32_t x)
+    {
+        return static_cast<float>(x >> 8) * (1.f / 16777216.f);
+    }
+
+    uint32_t ReverseBits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    /// Hash that only propagates bits upwards, i.e. applied to bit-reversed values it permutes the
+    /// elementary intervals like an Owen scramble (constants by Burley)
+    uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed)
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+    {
+        return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+    }
+
+    /// Second dimension of the Sobol sequence (the first one is the van der Corput sequence, i.e. ReverseBits())
+    uint32_t SobolSecondDimension(uint32_t index)
+    {
+        uint32_t result = 0u;
+        for (uint32_t v = 1u << 31; index != 0u; index >>= 1, v ^= v >> 1)
+        {
+            if (index & 1u)
+            {
+                result ^= v;
+            }
+        }
+        return result;
+    }
+
+    /// Ranks of a void-and-cluster blue-noise mask (Ulichney, "The void-and-cluster method for dither array generation", 1993),
+    /// generated once on first use
+    class BlueNoiseMask
+    {
+    public:
+        static const BlueNoiseMask& GetInstance()
+        {
+            static const BlueNoiseMask mask;
+            return mask;
+        }
+
+        uint32_t GetRank(int x, int y) const
+        {
+            return m_ranks[(y & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE + (x & (BLUE_NOISE_SIZE - 1))];
+        }
+
+    private:
+        static constexpr int NUM_PIXELS = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+
+        BlueNoiseMask();
+
+        void Toggle(int index, bool set)
+        {
+            m_pattern[index] = set;
+
+            // toroidal gaussian energy of the ones (the kernel is indexed by the wrapped offset)
+            int px = index & (BLUE_NOISE_SIZE - 1);
+            int py = index >> BLUE_NOISE_SIZE_LOG2;
+            float sign = set ? 1.f : -1.f;
+            for (int y = 0; y < BLUE_NOISE_SIZE; ++y)
+            {
+                const float* kernelRow = &m_kernel[((y - py) & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE];
+                float* energyRow = &m_energy[y * BLUE_NOISE_SIZE];
+                for (int x = 0; x < BLUE_NOISE_SIZE; ++x)
+                {
+                    energyRow[x] += sign * kernelRow[(x - px) & (BLUE_NOISE_SIZE - 1)];
+                }
+            }
+        }
+
+        /// The one with the highest energy
+        int FindTightestCluster() const
+        {
+            int best = -1;
+            for (int i = 0; i < NUM_PIXELS; ++i)
+            {
+                if (m_pattern[i] && (best < 0 || m_energy[i] > m_energy[best]))
+                {
+                    best = i;
+                }
+            }
+            return best;
+        }
+
+        /// The zero with the lowest energy
+        int FindLargestVoid() const
+        {
+            int best = -1;
+            for (int i = 0; i < NUM_PIXELS; ++i)
+            {
+                if (!m_pattern[i] && (best < 0 || m_energy[i] < m_energy[best]))
+                {
+                    best = i;
+                }
+            }
+            return best;
+        }
+
+        std::vector<float> m_kernel;
+        std::vector<float> m_energy;
+        std::vector<bool> m_pattern;
+        std::vector<uint16_t> m_ranks;
+    };
+
+    BlueNoiseMask::BlueNoiseMask()
+    : m_kernel(NUM_PIXELS)
+    , m_energy(NUM_PIXELS, 0.f)
+    , m_pattern(NUM_PIXELS, false)
+    , m_ranks(NUM_PIXELS, 0)
+    {
+        const float sigma = 1.5f;
+        for (int y = 0; y < BLUE_NOISE_SIZE; ++y)
+        {
+            for (int x = 0; x < BLUE_NOISE_SIZE; ++x)
+            {
+                float dx = static_cast<float>(glm::min(x, BLUE_NOISE_SIZE - x));
+                float dy = static_cast<float>(glm::min(y, BLUE_NOISE_SIZE - y));
+                m_kernel[y * BLUE_NOISE_SIZE + x] = glm::exp(-(dx * dx + dy * dy) / (2.f * sigma * sigma));
+            }
+        }
+
+        // random initial pattern with a tenth of the pixels set
+        Pcg32 rng;
+        const int numInitialOnes = NUM_PIXELS / 10;
+        for (int numOnes = 0; numOnes < numInitialOnes; )
+        {
+            int index = static_cast<int>(rng.NextUInt() % NUM_PIXELS);
+            if (!m_pattern[index])
+            {
+                Toggle(index, true);
+                ++numOnes;
+            }
+        }
+
+        // distribute the initial ones evenly by moving the tightest cluster into the largest void until that does not change anything
+        for (int iteration = 0; iteration < NUM_PIXELS; ++iteration)
+        {
+            int cluster = FindTightestCluster();
+            Toggle(cluster, false);
+            int largestVoid = FindLargestVoid();
+            Toggle(largestVoid, true);
+            if (largestVoid == cluster)
+            {
+                break;
+            }
+        }
+
+        std::vector<bool> initialPattern = m_pattern;
+        std::vector<float> initialEnergy = m_energy;
+
+        // the ones of the initial pattern are ranked by removing the tightest clusters first
+        for (int rank = numInitialOnes - 1; rank >= 0; --rank)
+        {
+            int cluster = FindTightestCluster();
+            Toggle(cluster, false);
+            m_ranks[cluster] = static_cast<uint16_t>(rank);
+        }
+
+        // all other pixels by filling the largest voids (with a gaussian filter, the tightest cluster of zeros
+        // is the largest void of ones, so this also covers the second half of the ranks)
+        m_pattern = initialPattern;
+        m_energy = initialEnergy;
+        for (int rank = numInitialOnes; rank < NUM_PIXELS; ++rank)
+        {
+            int largestVoid = FindLargestVoid();
+            Toggle(largestVoid, true);
+            m_ranks[largestVoid] = static_cast<uint16_t>(rank);
+        }
+    }
+}
+
+const char* GetSamplerName(SamplerType type)
+{
+    switch (type)
+    {
+    case SamplerType::Random:
+        return "random";
+    case SamplerType::Sobol:
+        return "sobol";
+    case SamplerType::R2:
+        return "r2";
+    case SamplerType::BlueNoise:
+        return "bluenoise";
+    default:
+        return "unknown";
+    }
+}
+
+std::unique_ptr<Sampler> CreateSampler(SamplerType type)
+{
+    switch (type)
+    {
+    case SamplerType::Random:
+        return std::unique_ptr<Sampler>(new RandomSampler());
+    case SamplerType::R2:
+        return std::unique_ptr<Sampler>(new R2Sampler());
+    case SamplerType::BlueNoise:
+        BlueNoiseMask::GetInstance();
+        return std::unique_ptr<Sampler>(new BlueNoiseSampler());
+    case SamplerType::Sobol:
+    default:
+        return std::unique_ptr<Sampler>(new SobolSampler());
+    }
+}
+
+//**************************************************************************//
+
+void RandomSampler::OnStartPixelSample()
+{
+    // counter-based: the numbers only depend on pixel, sample index and dimension
+    m_key = static_cast<uint32_t>(MixBits(m_pixelSeed ^ (static_cast<uint64_t>(m_sampleIndex) << 32)) >> 32);
+    m_blockStart = ~0u;
+}
+
+float RandomSampler::Sample1D(uint32_t dimension)
+{
+    uint32_t blockStart = dimension & ~7u;
+    if (blockStart != m_blockStart)
+    {
+        RandomFloats8(m_key, blockStart, m_block);
+        m_blockStart = blockStart;
+    }
+
+    return m_block[dimension & 7u];
+}
+
+glm::vec2 RandomSampler::Sample2D(uint32_t dimension)
+{
+    return glm::vec2(Sample1D(dimension), Sample1D(dimension + 1));
+}
+
+//**************************************************************************//
+
+float SobolSampler::Sample1D(uint32_t dimension)
+{
+    uint32_t seed = DimensionSeed(dimension);
+    uint32_t index = NestedUniformScramble(m_sampleIndex, seed);
+
+    return ToFloat(NestedUniformScramble(ReverseBits(index), static_cast<uint32_t>(MixBits(seed))));
+}
+
+glm::vec2 SobolSampler::Sample2D(uint32_t dimension)
+{
+    // both coordinates use the same shuffled index, so the pair keeps the (0, 2)-sequence stratification
+    uint32_t seed = DimensionSeed(dimension);
+    uint32_t index = NestedUniformScramble(m_sampleIndex, seed);
+
+    uint32_t x = NestedUniformScramble(ReverseBits(index), static_cast<uint32_t>(MixBits(seed)));
+    uint32_t y = NestedUniformScramble(SobolSecondDimension(index), static_cast<uint32_t>(MixBits(seed + 1u)));
+
+    return glm::vec2(ToFloat(x), ToFloat(y));
+}
+
+//**************************************************************************//
+
+float R2Sampler::Sample1D(uint32_t dimension)
+{
+    return ToFloat(Offset(dimension) + m_sampleIndex * GOLDEN_RATIO_INCREMENT);
+}
+
+glm::vec2 R2Sampler::Sample2D(uint32_t dimension)
+{
+    return glm::vec2(ToFloat(Offset(dimension) + m_sampleIndex * R2_INCREMENT_X), ToFloat(Offset(dimension + 1) + m_sampleIndex * R2_INCREMENT_Y));
+}
+
+uint32_t R2Sampler::Offset(uint32_t dimension) const
+{
+    return DimensionSeed(dimension);
+}
+
+//**************************************************************************//
+
+uint32_t BlueNoiseSampler::Offset(uint32_t dimension) const
+{
+    // the mask is shifted toroidally per dimension (the same for all pixels)
+    uint32_t shift = static_cast<uint32_t>(MixBits(dimension));
+    uint32_t rank = BlueNoiseMask::GetInstance().GetRank(m_x + static_cast<int>(shift & 0xffffu), m_y + static_cast<int>(shift >> 16));
+
+    // center of the rank's interval in 0.32 fixed point
+    return (2u * rank + 1u) << (31 - 2 * BLUE_NOISE_SIZE_LOG2);
+}
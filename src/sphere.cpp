@@ -1,6 +1,7 @@
 #include "sphere.h"
 
 #include "material.h"
+#include "sampling.h"
 
 Sphere::Sphere(glm::vec3 center, float radius, const Material* material)
 : m_center(center)
@@ -36,9 +37,63 @@ bool Sphere::Hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const
             rec.p = r.PointAt(rec.t);
             rec.normal = (rec.p - m_center) / m_radius;
             rec.material = m_material;
+            rec.object = this;
             return true;
         }
     }
 
     return false;
 }
+
+void Sphere::ComputeTextureCoordinates(HitRecord& rec) const
+{
+    // spherical coordinates (u around the y-axis, v from the bottom to the top)
+    glm::vec3 local = rec.p - m_center;
+    float absRadius = glm::abs(m_radius);
+    float phi = glm::atan(local.z, local.x);
+    float theta = glm::acos(glm::clamp(local.y / absRadius, -1.f, 1.f));
+
+    rec.uv = glm::vec2(phi / (2.f * SAMPLING_PI) + 0.5f, 1.f - theta / SAMPLING_PI);
+    rec.dpdu = 2.f * SAMPLING_PI * glm::vec3(-local.z, 0.f, local.x);
+    rec.dpdv = -SAMPLING_PI * absRadius * glm::vec3(glm::cos(theta) * glm::cos(phi), -glm::sin(theta), glm::cos(theta) * glm::sin(phi));
+}
+
+Aabb Sphere::BoundingBox() const
+{
+    // negative radii are used for hollow spheres
+    glm::vec3 r(glm::abs(m_radius));
+    return Aabb(m_center - r, m_center + r);
+}
+
+glm::vec3 Sphere::SampleDirection(const glm::vec3& p, const glm::vec2& u, float& pdf) const
+{
+    glm::vec3 toCenter = m_center - p;
+    float distanceSquared = glm::dot(toCenter, toCenter);
+    float radiusSquared = m_radius * m_radius;
+
+    // points inside of the sphere are not supported (the sphere does not subtend a cone)
+    if (distanceSquared <= radiusSquared)
+    {
+        pdf = 0.f;
+        return glm::vec3(0.f);
+    }
+
+    float cosThetaMax = glm::sqrt(1.f - radiusSquared / distanceSquared);
+    pdf = UniformConePdf(cosThetaMax);
+
+    return SampleUniformCone(toCenter / glm::sqrt(distanceSquared), cosThetaMax, u);
+}
+
+float Sphere::DirectionPdf(const glm::vec3& p) const
+{
+    glm::vec3 toCenter = m_center - p;
+    float distanceSquared = glm::dot(toCenter, toCenter);
+    float radiusSquared = m_radius * m_radius;
+
+    if (distanceSquared <= radiusSquared)
+    {
+        return 0.f;
+    }
+
+    return UniformConePdf(glm::sqrt(1.f - radiusSquared / distanceSquared));
+}
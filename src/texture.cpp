@@ -0,0 +1,297 @@
+#include "texture.h"
+
+#include "texturecache.h"
+
+#include <atomic>
+
+namespace
+{
+    constexpr int THREAD_TILE_CACHE_SIZE = 16;
+
+    std::atomic<uint32_t> s_nextTextureId(1);
+
+    /// lookup table for converting 8-bit sRGB values to linear
+    const float* SrgbToLinearTable()
+    {
+        static float table[256];
+        static bool initialized = [&]()
+            {
+                for (int i = 0; i < 256; ++i)
+                {
+                    float c = static_cast<float>(i) / 255.f;
+                    table[i] = (c <= 0.04045f) ? c / 12.92f : glm::pow((c + 0.055f) / 1.055f, 2.4f);
+                }
+                return true;
+            }();
+        (void)initialized;
+
+        return table;
+    }
+
+    uint8_t LinearToSrgb(float c)
+    {
+        c = glm::clamp(c, 0.f, 1.f);
+        c = (c <= 0.0031308f) ? c * 12.92f : 1.055f * glm::pow(c, 1.f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(c * 255.f + 0.5f);
+    }
+
+    /// interleaves the bits of x and y (both < TextureTile::SIZE) to get the index of a texel within a tile
+    int MortonIndex(int x, int y)
+    {
+        auto spread = [](int v)
+            {
+                v = (v | (v << 4)) & 0x0F0F;
+                v = (v | (v << 2)) & 0x3333;
+                v = (v | (v << 1)) & 0x5555;
+                return v;
+            };
+
+        return spread(x) | (spread(y) << 1);
+    }
+
+    /// 2x2 box filter in linear space (odd sizes replicate the last row or column)
+    std::vector<uint32_t> Downsample(const std::vector<uint32_t>& pixels, int width, int height, int newWidth, int newHeight)
+    {
+        const float* toLinear = SrgbToLinearTable();
+        std::vector<uint32_t> result(newWidth * newHeight);
+
+        for (int y = 0; y < newHeight; ++y)
+        {
+            for (int x = 0; x < newWidth; ++x)
+            {
+                float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+                for (int dy = 0; dy < 2; ++dy)
+                {
+                    for (int dx = 0; dx < 2; ++dx)
+                    {
+                        uint32_t p = pixels[std::min(2 * y + dy, height - 1) * width + std::min(2 * x + dx, width - 1)];
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            sum[c] += toLinear[(p >> (8 * c)) & 0xFF];
+                        }
+                        sum[3] += static_cast<float>(p >> 24);
+                    }
+                }
+
+                uint32_t p = static_cast<uint32_t>(sum[3] * 0.25f + 0.5f) << 24;
+                for (int c = 0; c < 3; ++c)
+                {
+                    p |= static_cast<uint32_t>(LinearToSrgb(sum[c] * 0.25f)) << (8 * c);
+                }
+                result[y * newWidth + x] = p;
+            }
+        }
+
+        return result;
+    }
+}
+
+ImageTexture::ImageTexture(float uvScale)
+: m_id(s_nextTextureId++)
+, m_uvScale(uvScale)
+, m_backingFile(nullptr)
+{
+}
+
+ImageTexture::~ImageTexture()
+{
+    TextureCache::GetInstance().EvictTexture(m_id);
+
+    if (m_backingFile != nullptr)
+    {
+        std::fclose(m_backingFile);
+    }
+}
+
+std::unique_ptr<ImageTexture> ImageTexture::Create(int width, int height, const std::vector<uint32_t>& pixels, float uvScale)
+{
+    if (width <= 0 || height <= 0 || pixels.size() < static_cast<size_t>(width * height))
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<ImageTexture> texture(new ImageTexture(uvScale));
+
+    texture->m_backingFile = std::tmpfile();
+    if (texture->m_backingFile == nullptr)
+    {
+        return nullptr;
+    }
+
+    // build the mip chain and write each level tile by tile
+    std::vector<uint32_t> levelPixels = pixels;
+    long fileOffset = 0;
+    TextureTile tile;
+
+    while (true)
+    {
+        MipLevel level;
+        level.width = width;
+        level.height = height;
+        level.tilesX = (width + TextureTile::SIZE - 1) / TextureTile::SIZE;
+        level.tilesY = (height + TextureTile::SIZE - 1) / TextureTile::SIZE;
+        level.fileOffset = fileOffset;
+        texture->m_levels.push_back(level);
+
+        for (int ty = 0; ty < level.tilesY; ++ty)
+        {
+            for (int tx = 0; tx < level.tilesX; ++tx)
+            {
+                for (int y = 0; y < TextureTile::SIZE; ++y)
+                {
+                    for (int x = 0; x < TextureTile::SIZE; ++x)
+                    {
+                        // texels outside of the image (in border tiles) are never fetched
+                        int px = std::min(tx * TextureTile::SIZE + x, width - 1);
+                        int py = std::min(ty * TextureTile::SIZE + y, height - 1);
+                        tile.texels[MortonIndex(x, y)] = levelPixels[py * width + px];
+                    }
+                }
+
+                if (std::fwrite(&tile, sizeof(TextureTile), 1, texture->m_backingFile) != 1)
+                {
+                    return nullptr;
+                }
+                fileOffset += static_cast<long>(sizeof(TextureTile));
+            }
+        }
+
+        if (width == 1 && height == 1)
+        {
+            break;
+        }
+
+        int newWidth = std::max(1, width / 2);
+        int newHeight = std::max(1, height / 2);
+        levelPixels = Downsample(levelPixels, width, height, newWidth, newHeight);
+        width = newWidth;
+        height = newHeight;
+    }
+
+    std::fflush(texture->m_backingFile);
+
+    return texture;
+}
+
+std::unique_ptr<ImageTexture> ImageTexture::LoadBMP(const char* filename, float uvScale)
+{
+    SDL_Surface* bmp = SDL_LoadBMP(filename);
+    if (bmp == nullptr)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not load texture %s: %s.", filename, SDL_GetError());
+        return nullptr;
+    }
+
+    SDL_Surface* rgba = SDL_ConvertSurfaceFormat(bmp, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(bmp);
+    if (rgba == nullptr)
+    {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not convert texture %s: %s.", filename, SDL_GetError());
+        return nullptr;
+    }
+
+    std::vector<uint32_t> pixels(rgba->w * rgba->h);
+    SDL_LockSurface(rgba);
+    for (int y = 0; y < rgba->h; ++y)
+    {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(rgba->pixels) + y * rgba->pitch);
+        std::copy(row, row + rgba->w, pixels.begin() + y * rgba->w);
+    }
+    SDL_UnlockSurface(rgba);
+
+    int width = rgba->w;
+    int height = rgba->h;
+    SDL_FreeSurface(rgba);
+
+    return Create(width, height, pixels, uvScale);
+}
+
+void ImageTexture::LoadTile(int level, int tileIndex, TextureTile& tile) const
+{
+    std::lock_guard<std::mutex> lck(m_fileMutex);
+
+    long offset = m_levels[level].fileOffset + static_cast<long>(tileIndex) * static_cast<long>(sizeof(TextureTile));
+    if (std::fseek(m_backingFile, offset, SEEK_SET) != 0 || std::fread(&tile, sizeof(TextureTile), 1, m_backingFile) != 1)
+    {
+        // should not happen - show magenta instead of crashing
+        std::fill(tile.texels, tile.texels + TextureTile::NUM_TEXELS, 0xFFFF00FF);
+    }
+}
+
+uint32_t ImageTexture::FetchTexel(int level, int x, int y) const
+{
+    // small per-thread cache of recently used tiles avoids locking the global cache for most lookups
+    struct CachedTile
+    {
+        uint64_t key = 0;
+        std::shared_ptr<const TextureTile> tile;
+    };
+    static thread_local CachedTile threadCache[THREAD_TILE_CACHE_SIZE];
+
+    const MipLevel& mipLevel = m_levels[level];
+    int tileIndex = (y >> TextureTile::SIZE_LOG2) * mipLevel.tilesX + (x >> TextureTile::SIZE_LOG2);
+
+    uint64_t key = (static_cast<uint64_t>(m_id) << 32) | (static_cast<uint64_t>(level) << 27) | static_cast<uint64_t>(tileIndex);
+    CachedTile& cached = threadCache[(key ^ (key >> 32) ^ (key >> 27)) % THREAD_TILE_CACHE_SIZE];
+
+    if (cached.key != key || !cached.tile)
+    {
+        cached.tile = TextureCache::GetInstance().GetTile(*this, level, tileIndex);
+        cached.key = key;
+    }
+
+    return cached.tile->texels[MortonIndex(x & (TextureTile::SIZE - 1), y & (TextureTile::SIZE - 1))];
+}
+
+glm::vec3 ImageTexture::Bilinear(int level, glm::vec2 uv) const
+{
+    const MipLevel& mipLevel = m_levels[level];
+    const float* toLinear = SrgbToLinearTable();
+
+    // texel centers are at half-integer coordinates, v = 0 is the bottom row of the image
+    float x = uv.x * static_cast<float>(mipLevel.width) - 0.5f;
+    float y = (1.f - uv.y) * static_cast<float>(mipLevel.height) - 0.5f;
+    float fx = glm::floor(x);
+    float fy = glm::floor(y);
+    float wx = x - fx;
+    float wy = y - fy;
+
+    auto wrap = [](int v, int size) { v %= size; return (v < 0) ? v + size : v; };
+    int x0 = wrap(static_cast<int>(fx), mipLevel.width);
+    int y0 = wrap(static_cast<int>(fy), mipLevel.height);
+    int x1 = (x0 + 1 == mipLevel.width) ? 0 : x0 + 1;
+    int y1 = (y0 + 1 == mipLevel.height) ? 0 : y0 + 1;
+
+    auto texel = [&](int tx, int ty)
+        {
+            uint32_t p = FetchTexel(level, tx, ty);
+            return glm::vec3(toLinear[p & 0xFF], toLinear[(p >> 8) & 0xFF], toLinear[(p >> 16) & 0xFF]);
+        };
+
+    return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), wx), glm::mix(texel(x0, y1), texel(x1, y1), wx), wy);
+}
+
+glm::vec3 ImageTexture::Value(const glm::vec2& uv, const glm::vec2& duvdx, const glm::vec2& duvdy) const
+{
+    glm::vec2 st = uv * m_uvScale;
+    st -= glm::floor(st);
+
+    // choose the mip level from the larger of the two footprint axes (in texels of the finest level)
+    glm::vec2 size(static_cast<float>(m_levels[0].width), static_cast<float>(m_levels[0].height));
+    glm::vec2 footprintX = duvdx * m_uvScale * size;
+    glm::vec2 footprintY = duvdy * m_uvScale * size;
+    float width = glm::max(glm::dot(footprintX, footprintX), glm::dot(footprintY, footprintY));
+
+    int maxLevel = GetNumLevels() - 1;
+    float lod = (width > 1.f) ? glm::min(0.5f * glm::log2(width), static_cast<float>(maxLevel)) : 0.f;
+
+    int level = static_cast<int>(lod);
+    float t = lod - static_cast<float>(level);
+
+    if (t == 0.f || level == maxLevel)
+    {
+        return Bilinear(level, st);
+    }
+
+    return glm::mix(Bilinear(level, st), Bilinear(level + 1, st), t);
+}
@@ -0,0 +1,112 @@
+#include "texturecache.h"
+
+#include <algorithm>
+
+constexpr size_t DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+TextureCache& TextureCache::GetInstance()
+{
+    static TextureCache instance;
+    return instance;
+}
+
+TextureCache::TextureCache()
+{
+    SetMemoryBudget(DEFAULT_MEMORY_BUDGET);
+}
+
+void TextureCache::SetMemoryBudget(size_t bytes)
+{
+    m_maxTilesPerShard = std::max<size_t>(1, bytes / (NUM_SHARDS * sizeof(TextureTile)));
+
+    // shrink all shards to the new budget
+    for (auto& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lck(shard.mutex);
+        while (shard.entries.size() > m_maxTilesPerShard)
+        {
+            shard.entries.erase(shard.lru.back());
+            shard.lru.pop_back();
+        }
+    }
+}
+
+std::shared_ptr<const TextureTile> TextureCache::GetTile(const ImageTexture& texture, int level, int tileIndex)
+{
+    uint64_t key = (static_cast<uint64_t>(texture.GetId()) << 32) | (static_cast<uint64_t>(level) << 27) | static_cast<uint64_t>(tileIndex);
+    Shard& shard = m_shards[(key ^ (key >> 29)) % NUM_SHARDS];
+
+    {
+        std::lock_guard<std::mutex> lck(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruPosition);
+            shard.hits++;
+            return it->second.tile;
+        }
+        shard.misses++;
+    }
+
+    // load without holding the lock (another thread may load the same tile concurrently, the first one wins)
+    std::shared_ptr<TextureTile> tile = std::make_shared<TextureTile>();
+    texture.LoadTile(level, tileIndex, *tile);
+
+    std::lock_guard<std::mutex> lck(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end())
+    {
+        return it->second.tile;
+    }
+
+    while (!shard.entries.empty() && shard.entries.size() >= m_maxTilesPerShard)
+    {
+        shard.entries.erase(shard.lru.back());
+        shard.lru.pop_back();
+    }
+
+    shard.lru.push_front(key);
+    shard.entries[key] = Entry{ tile, shard.lru.begin() };
+
+    return tile;
+}
+
+void TextureCache::EvictTexture(uint32_t textureId)
+{
+    for (auto& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lck(shard.mutex);
+        for (auto it = shard.lru.begin(); it != shard.lru.end();)
+        {
+            if (static_cast<uint32_t>(*it >> 32) == textureId)
+            {
+                shard.entries.erase(*it);
+                it = shard.lru.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+uint64_t TextureCache::GetNumHits() const
+{
+    uint64_t hits = 0;
+    for (auto& shard : m_shards)
+    {
+        hits += shard.hits;
+    }
+    return hits;
+}
+
+uint64_t TextureCache::GetNumMisses() const
+{
+    uint64_t misses = 0;
+    for (auto& shard : m_shards)
+    {
+        misses += shard.misses;
+    }
+    return misses;
+}
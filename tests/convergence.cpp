@@ -0,0 +1,177 @@
+//**************************************************************************//
+// convergence of the samplers: error of the image against a reference over //
+// the number of samples, printed as CSV for plotting                       //
+//**************************************************************************//
+
+#include "dielectric.h"
+#include "hitablelist.h"
+#include "lambertian.h"
+#include "metal.h"
+#include "renderer.h"
+#include "sphere.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// small image, so a reference with many samples is affordable
+constexpr int WIDTH = 120;
+constexpr int HEIGHT = 80;
+
+// camera rays per pixel and refinement iteration (see the renderer)
+constexpr int SAMPLES_PER_PASS = 4;
+
+constexpr int DEFAULT_REFERENCE_PASSES = 1024;
+constexpr int DEFAULT_MAX_PASSES = 128;
+
+// reference channels at or above this value are clamped by the resolve, so their error says nothing about convergence
+constexpr uint32_t SATURATED = 250;
+
+namespace
+{
+    /// Spheres on a diffuse floor under the sky (the default scene without the random spheres), so both the pixel and the
+    /// bounce dimensions matter. Small emitters would add fireflies that dominate the error for thousands of samples.
+    struct Scene
+    {
+        std::vector<Lambertian> lambertians;
+        std::vector<Metal> metals;
+        std::vector<Dielectric> dielectrics;
+        std::vector<Sphere> spheres;
+        HitableList world;
+
+        Scene()
+        {
+            lambertians.push_back(Lambertian(glm::vec3(0.5f)));
+            for (int i = 0; i < 12; ++i)
+            {
+                lambertians.push_back(Lambertian(glm::vec3(0.2f + 0.05f * i, 0.5f, 0.7f - 0.04f * i)));
+            }
+            metals.push_back(Metal(glm::vec3(0.8f), 0.01f));
+            metals.push_back(Metal(glm::vec3(0.8f, 0.6f, 0.2f), 0.1f));
+            dielectrics.push_back(Dielectric(1.5f));
+
+            spheres.push_back(Sphere(glm::vec3(0.f, -301.f, 0.f), 300.f, &lambertians[0]));
+            spheres.push_back(Sphere(glm::vec3(0.f, 0.f, 0.f), 1.f, &metals[0]));
+            spheres.push_back(Sphere(glm::vec3(2.2f, 0.15f, 0.f), 1.f, &metals[1]));
+            spheres.push_back(Sphere(glm::vec3(-2.1f, 0.1f, 0.4f), 0.8f, &dielectrics[0]));
+            spheres.push_back(Sphere(glm::vec3(-2.1f, 0.1f, 0.4f), -0.7f, &dielectrics[0]));
+            for (int i = 0; i < 12; ++i)
+            {
+                spheres.push_back(Sphere(glm::vec3(-4.5f + 0.8f * i, -0.75f, static_cast<float>((i * 7) % 5) - 2.f), 0.25f, &lambertians[1 + i]));
+            }
+
+            // the spheres do not move anymore, so the pointers stay valid
+            for (auto& s : spheres)
+            {
+                world.AddToList(&s);
+            }
+        }
+    };
+
+    void SetupRenderer(Renderer& r, SamplerType samplerType)
+    {
+        r.SetSamplerType(samplerType);
+        r.GetTrackball().UpdateElevationAngle(-0.3f);
+        r.GetTrackball().SetRadius(3.3f);
+        r.GetTrackball().UpdatePolarAngle(0.5f);
+    }
+
+    /// Root mean square error of the channels in linear space (the resolve applies gamma 2), saturated reference
+    /// channels are skipped
+    double ComputeError(const std::vector<uint32_t>& pixels, const std::vector<uint32_t>& reference)
+    {
+        double squaredErrorSum = 0.0;
+        size_t count = 0;
+        for (size_t i = 0; i < pixels.size(); ++i)
+        {
+            for (int shift = 0; shift < 24; shift += 8)
+            {
+                uint32_t expected = (reference[i] >> shift) & 0xFFu;
+                if (expected >= SATURATED)
+                {
+                    continue;
+                }
+
+                double value = ((pixels[i] >> shift) & 0xFFu) / 255.0;
+                double error = value * value - (expected / 255.0) * (expected / 255.0);
+                squaredErrorSum += error * error;
+                ++count;
+            }
+        }
+        return (count > 0) ? std::sqrt(squaredErrorSum / count) : 0.0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int referencePasses = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_REFERENCE_PASSES;
+    int maxPasses = (argc > 2) ? std::atoi(argv[2]) : DEFAULT_MAX_PASSES;
+    if (referencePasses <= 0 || maxPasses <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [reference passes (default %d)] [maximum passes (default %d)]\n", argv[0],
+            DEFAULT_REFERENCE_PASSES, DEFAULT_MAX_PASSES);
+        return 1;
+    }
+
+    Scene scene;
+    Viewport viewport(WIDTH, HEIGHT);
+
+    // the reference uses independent random numbers, so its remaining error is not correlated with any of the samplers
+    std::vector<uint32_t> reference(WIDTH * HEIGHT);
+    {
+        Renderer r(viewport);
+        SetupRenderer(r, SamplerType::Random);
+        for (int pass = 0; pass < referencePasses; ++pass)
+        {
+            r.Render(scene.world, reference.data());
+        }
+    }
+
+    // the error at every power of two passes, and the slope of log(error) over log(samples) fitted by least squares
+    // (-0.5 for plain Monte Carlo, lower is better)
+    std::printf("sampler,samples per pixel,seconds,rmse\n");
+    std::vector<uint32_t> pixels(WIDTH * HEIGHT);
+    for (int type = 0; type < static_cast<int>(SamplerType::Count); ++type)
+    {
+        SamplerType samplerType = static_cast<SamplerType>(type);
+        Renderer r(viewport);
+        SetupRenderer(r, samplerType);
+
+        double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+        int points = 0;
+        double seconds = 0.0;
+        for (int pass = 1; pass <= maxPasses; ++pass)
+        {
+            auto start = std::chrono::steady_clock::now();
+            r.Render(scene.world, pixels.data());
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if ((pass & (pass - 1)) != 0)
+            {
+                continue;
+            }
+
+            int samples = pass * SAMPLES_PER_PASS;
+            double error = ComputeError(pixels, reference);
+            std::printf("%s,%d,%.3f,%.6f\n", GetSamplerName(samplerType), samples, seconds, error);
+
+            double x = std::log(static_cast<double>(samples));
+            double y = std::log(glm::max(error, 1e-12));
+            sumX += x;
+            sumY += y;
+            sumXX += x * x;
+            sumXY += x * y;
+            ++points;
+        }
+
+        if (points > 1)
+        {
+            double slope = (points * sumXY - sumX * sumY) / (points * sumXX - sumX * sumX);
+            std::fprintf(stderr, "%-10s error ~ samples^%.2f\n", GetSamplerName(samplerType), slope);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+//**************************************************************************//
+// microbenchmarks of the sampling warps against the rejection samplers     //
+// they replaced, and of the 8-lane random numbers against scalar PCG32     //
+//**************************************************************************//
+
+#include "random.h"
+#include "sampling.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+constexpr int NUM_SAMPLES = 1 << 24;
+constexpr int NUM_RANDOM_FLOATS = 1 << 27;
+
+namespace
+{
+    /// Rejection sampling of a point in the unit ball, as the materials did before the warps
+    glm::vec3 RandomInUnitSphere(Pcg32& rng)
+    {
+        glm::vec3 p;
+        do
+        {
+            p = 2.f * glm::vec3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat()) - glm::vec3(1.f);
+        } while (glm::dot(p, p) >= 1.f);
+        return p;
+    }
+
+    /// Runs sample NUM_SAMPLES times and prints the throughput. The results are summed, so they cannot be optimized
+    /// away.
+    template <typename Sampler>
+    void Measure(const char* name, Sampler sample)
+    {
+        Pcg32 rng(0x2468u, 0x1357u);
+        glm::vec3 sum(0.f);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < NUM_SAMPLES; ++i)
+        {
+            sum += sample(rng);
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        std::printf("%-40s %8.1f M samples/s %7.2f ns/sample   (checksum %.3f)\n", name,
+            NUM_SAMPLES / seconds.count() * 1e-6, seconds.count() * 1e9 / NUM_SAMPLES, sum.x + sum.y + sum.z);
+    }
+
+    /// Generates NUM_RANDOM_FLOATS numbers in blocks of eight with generate(block, out) and prints the throughput
+    template <typename Generator>
+    void MeasureRandomFloats(const char* name, Generator generate)
+    {
+        float block[8];
+        float sum[8] = {};
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < static_cast<uint32_t>(NUM_RANDOM_FLOATS / 8); ++i)
+        {
+            generate(i, block);
+            for (int lane = 0; lane < 8; ++lane)
+            {
+                sum[lane] += block[lane];
+            }
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        float checksum = 0.f;
+        for (float s : sum)
+        {
+            checksum += s;
+        }
+        std::printf("%-40s %8.1f M floats/s  %7.2f ns/float    (mean %.4f)\n", name,
+            NUM_RANDOM_FLOATS / seconds.count() * 1e-6, seconds.count() * 1e9 / NUM_RANDOM_FLOATS, checksum / NUM_RANDOM_FLOATS);
+    }
+}
+
+int main()
+{
+    const glm::vec3 normal = glm::normalize(glm::vec3(0.3f, -0.8f, 0.5f));
+    const float fuzz = 0.3f;
+
+    // the rejection loop accepts a point with probability pi/6, so it draws 5.7 floats per sample on average
+    Measure("unit sphere: rejection", [](Pcg32& rng) { return glm::normalize(RandomInUnitSphere(rng)); });
+    Measure("unit sphere: warp", [](Pcg32& rng) { return SampleUniformSphere(glm::vec2(rng.NextFloat(), rng.NextFloat())); });
+
+    Measure("diffuse: normal + rejection", [&normal](Pcg32& rng) { return glm::normalize(normal + RandomInUnitSphere(rng)); });
+    Measure("diffuse: cosine hemisphere warp", [&normal](Pcg32& rng)
+    {
+        return SampleCosineHemisphere(normal, glm::vec2(rng.NextFloat(), rng.NextFloat()));
+    });
+
+    // a ball of radius fuzz around the unit reflection vector subtends the cone with sin(thetaMax) = fuzz
+    const float cosThetaMax = std::sqrt(1.f - fuzz * fuzz);
+    Measure("fuzzy metal: reflection + rejection", [&normal, fuzz](Pcg32& rng)
+    {
+        return glm::normalize(normal + fuzz * RandomInUnitSphere(rng));
+    });
+    Measure("fuzzy metal: uniform cone warp", [&normal, cosThetaMax](Pcg32& rng)
+    {
+        return SampleUniformCone(normal, cosThetaMax, glm::vec2(rng.NextFloat(), rng.NextFloat()));
+    });
+
+    // the random sampler hashes eight dimensions at once, the other paths draw from a PCG32 generator one at a time
+    Pcg32 rng(0x2468u, 0x1357u);
+    MeasureRandomFloats("random floats: PCG32, one at a time", [&rng](uint32_t, float* out)
+    {
+        for (int lane = 0; lane < 8; ++lane)
+        {
+            out[lane] = rng.NextFloat();
+        }
+    });
+#if defined(__AVX2__)
+    const char* randomFloats8Name = "random floats: RandomFloats8 (AVX2)";
+#else
+    const char* randomFloats8Name = "random floats: RandomFloats8 (scalar)";
+#endif
+    MeasureRandomFloats(randomFloats8Name, [](uint32_t block, float* out) { RandomFloats8(0x9E3779B9u, 8u * block, out); });
+
+    return 0;
+}
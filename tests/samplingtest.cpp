@@ -0,0 +1,188 @@
+//**************************************************************************//
+// statistical checks of the sampling warps: chi-square tests of the        //
+// histograms of the directions against the densities, and moments          //
+//**************************************************************************//
+
+#include "random.h"
+#include "sampling.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+constexpr int NUM_SAMPLES = 1 << 20;
+
+// bins in the polar and azimuthal direction (of the warped coordinates, so the expected counts are equal)
+constexpr int THETA_BINS = 16;
+constexpr int PHI_BINS = 32;
+
+// a chi-square statistic beyond this many standard deviations (Wilson-Hilferty) fails, i.e. p < 3e-5
+constexpr double MAX_CHI_SQUARE_DEVIATION = 4.0;
+
+namespace
+{
+    int g_failures = 0;
+
+    void Check(bool passed, const char* name, const char* format, double value, double expected)
+    {
+        std::printf("%-48s %s ", name, passed ? "ok    " : "FAILED");
+        std::printf(format, value, expected);
+        std::printf("\n");
+        g_failures += passed ? 0 : 1;
+    }
+
+    /// Number of standard deviations of a chi-square statistic with the given degrees of freedom
+    /// (Wilson-Hilferty transformation to a standard normal variable)
+    double ChiSquareDeviation(double chiSquare, int degreesOfFreedom)
+    {
+        double k = static_cast<double>(degreesOfFreedom);
+        double variance = 2.0 / (9.0 * k);
+        return (std::cbrt(chiSquare / k) - (1.0 - variance)) / std::sqrt(variance);
+    }
+
+    /// Direction in the frame (b1, b2, axis): cosine of the polar angle and azimuth in [0, 1)
+    void ToLocal(const glm::vec3& d, const glm::vec3& axis, float& cosTheta, float& phi)
+    {
+        glm::vec3 b1, b2;
+        BuildOrthonormalBasis(axis, b1, b2);
+        cosTheta = glm::clamp(glm::dot(d, axis), -1.f, 1.f);
+        phi = std::atan2(glm::dot(d, b2), glm::dot(d, b1)) / (2.f * SAMPLING_PI);
+        phi = (phi < 0.f) ? phi + 1.f : phi;
+    }
+
+    /// Samples a warp and tests the histogram over (thetaBin(cosTheta), phi) against equal counts. The direction has
+    /// to be normalized and the inverse pdf averages to the solid angle of the support.
+    void TestWarp(const char* name, const glm::vec3& axis, const std::function<glm::vec3(const glm::vec2&)>& warp,
+        const std::function<float(const glm::vec3&)>& pdf, const std::function<int(float)>& thetaBin, double solidAngle)
+    {
+        Pcg32 rng(0x1234u, std::hash<std::string>()(name));
+        std::vector<double> counts(THETA_BINS * PHI_BINS, 0.0);
+        double maxLengthError = 0.0;
+        double inversePdfSum = 0.0;
+        int outside = 0;
+
+        for (int i = 0; i < NUM_SAMPLES; ++i)
+        {
+            glm::vec3 d = warp(glm::vec2(rng.NextFloat(), rng.NextFloat()));
+            maxLengthError = glm::max(maxLengthError, static_cast<double>(glm::abs(glm::length(d) - 1.f)));
+
+            float cosTheta, phi;
+            ToLocal(d, axis, cosTheta, phi);
+            int t = thetaBin(cosTheta);
+            if (t < 0 || t >= THETA_BINS)
+            {
+                ++outside;
+                continue;
+            }
+            int p = glm::min(static_cast<int>(phi * PHI_BINS), PHI_BINS - 1);
+            counts[t * PHI_BINS + p] += 1.0;
+
+            inversePdfSum += 1.0 / pdf(d);
+        }
+
+        double expected = static_cast<double>(NUM_SAMPLES) / counts.size();
+        double chiSquare = 0.0;
+        for (double c : counts)
+        {
+            chiSquare += (c - expected) * (c - expected) / expected;
+        }
+
+        char label[96];
+        std::snprintf(label, sizeof(label), "%s: chi-square", name);
+        double deviation = ChiSquareDeviation(chiSquare, static_cast<int>(counts.size()) - 1);
+        Check(deviation < MAX_CHI_SQUARE_DEVIATION, label, "%.1f sigma (limit %.0f)", deviation, MAX_CHI_SQUARE_DEVIATION);
+
+        std::snprintf(label, sizeof(label), "%s: samples outside the support", name);
+        Check(outside == 0, label, "%.0f (expected %.0f)", outside, 0.0);
+
+        std::snprintf(label, sizeof(label), "%s: length", name);
+        Check(maxLengthError < 1e-5, label, "max error %.1e (limit %.0e)", maxLengthError, 1e-5);
+
+        std::snprintf(label, sizeof(label), "%s: mean inverse pdf", name);
+        double meanInversePdf = inversePdfSum / NUM_SAMPLES;
+        Check(std::abs(meanInversePdf / solidAngle - 1.0) < 0.01, label, "%.4f (expected %.4f)", meanInversePdf, solidAngle);
+    }
+
+    /// Mean of f over the warped directions, compared with its expected value
+    void TestMoment(const char* name, const std::function<glm::vec3(const glm::vec2&)>& warp,
+        const std::function<double(const glm::vec3&)>& f, double expected, double tolerance)
+    {
+        Pcg32 rng(0x5678u, std::hash<std::string>()(name));
+        double sum = 0.0;
+        for (int i = 0; i < NUM_SAMPLES; ++i)
+        {
+            sum += f(warp(glm::vec2(rng.NextFloat(), rng.NextFloat())));
+        }
+        double mean = sum / NUM_SAMPLES;
+        Check(std::abs(mean - expected) < tolerance, name, "%.5f (expected %.5f)", mean, expected);
+    }
+
+    int BinUniform(float x, float lower, float upper)
+    {
+        return static_cast<int>(std::floor((x - lower) / (upper - lower) * THETA_BINS));
+    }
+}
+
+int main()
+{
+    const glm::vec3 axes[] = { glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f), glm::normalize(glm::vec3(0.3f, -0.8f, 0.5f)) };
+
+    // uniform sphere: z = cos(theta) is uniform in [-1, 1]
+    {
+        const glm::vec3 axis(0.f, 0.f, 1.f);
+        auto warp = [](const glm::vec2& u) { return SampleUniformSphere(u); };
+        TestWarp("uniform sphere", axis, warp, [](const glm::vec3&) { return UniformSpherePdf(); },
+            [](float c) { return BinUniform(c, -1.f, 1.f); }, 4.0 * SAMPLING_PI);
+        TestMoment("uniform sphere: E[z]", warp, [](const glm::vec3& d) { return d.z; }, 0.0, 3e-3);
+        TestMoment("uniform sphere: E[z^2]", warp, [](const glm::vec3& d) { return d.z * d.z; }, 1.0 / 3.0, 3e-3);
+    }
+
+    // cosine-weighted hemisphere: cos^2(theta) is uniform in [0, 1]
+    for (const glm::vec3& axis : axes)
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "cosine hemisphere (%.1f, %.1f, %.1f)", axis.x, axis.y, axis.z);
+        auto warp = [&axis](const glm::vec2& u) { return SampleCosineHemisphere(axis, u); };
+        TestWarp(name, axis, warp, [&axis](const glm::vec3& d) { return CosineHemispherePdf(glm::dot(d, axis)); },
+            [](float c) { return (c < 0.f) ? -1 : BinUniform(c * c, 0.f, 1.f); }, 2.0 * SAMPLING_PI);
+
+        std::snprintf(name, sizeof(name), "cosine hemisphere (%.1f, %.1f, %.1f): E[cos]", axis.x, axis.y, axis.z);
+        TestMoment(name, warp, [&axis](const glm::vec3& d) { return glm::dot(d, axis); }, 2.0 / 3.0, 3e-3);
+    }
+
+    // uniform cone: cos(theta) is uniform in [cosThetaMax, 1]
+    const float cosThetaMaxima[] = { 0.99f, 0.8f, 0.f, -0.6f };
+    for (float cosThetaMax : cosThetaMaxima)
+    {
+        for (const glm::vec3& axis : axes)
+        {
+            char name[64];
+            std::snprintf(name, sizeof(name), "cone %.2f (%.1f, %.1f, %.1f)", cosThetaMax, axis.x, axis.y, axis.z);
+            auto warp = [&axis, cosThetaMax](const glm::vec2& u) { return SampleUniformCone(axis, cosThetaMax, u); };
+            TestWarp(name, axis, warp, [cosThetaMax](const glm::vec3&) { return UniformConePdf(cosThetaMax); },
+                [cosThetaMax](float c) { return BinUniform(c, cosThetaMax - 1e-6f, 1.f + 1e-6f); },
+                2.0 * SAMPLING_PI * (1.0 - cosThetaMax));
+
+            std::snprintf(name, sizeof(name), "cone %.2f (%.1f, %.1f, %.1f): E[cos]", cosThetaMax, axis.x, axis.y, axis.z);
+            TestMoment(name, warp, [&axis](const glm::vec3& d) { return glm::dot(d, axis); }, 0.5 * (1.0 + cosThetaMax),
+                3e-3 * (1.0 - cosThetaMax));
+        }
+    }
+
+    // Schlick's approximation against the definition with pow
+    {
+        double maxError = 0.0;
+        for (int i = 0; i <= 1000; ++i)
+        {
+            float cosine = static_cast<float>(i) / 1000.f;
+            double reference = 0.04 + 0.96 * std::pow(1.0 - cosine, 5.0);
+            maxError = glm::max(maxError, std::abs(SchlickFresnel(cosine, 0.04f) - reference));
+        }
+        Check(maxError < 1e-6, "Schlick Fresnel", "max error %.1e (limit %.0e)", maxError, 1e-6);
+    }
+
+    std::printf("%d check(s) failed\n", g_failures);
+    return (g_failures == 0) ? 0 : 1;
+}